@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub sample ring
+ *
+ * Provides a character device per SFH, which userspace can mmap()
+ * read-only to obtain the samples of all sampled sensors from a shared
+ * ring buffer without a system call per sample.
+ * poll() reports new samples since the last time it reported readiness.
+ * Readers can keep sensors sampled themselves with AMD_SFH_RING_SAMPLE,
+ * so that they do not depend on other consumers opening them.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/pci.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-cdev.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-sched.h"
+
+/**
+ * struct amd_sfh_ring - Shared sample ring of an SFH.
+ * @kref:	Keeps the ring alive while it is open or mapped
+ * @misc:	Character device
+ * @lock:	Serializes writers
+ * @wait:	Readers waiting for new samples
+ * @header:	Header of the mappable memory
+ * @entries:	Entries of the mappable memory
+ * @privdata:	SFH driver data or NULL once the SFH is removed
+ * @files:	Open files of the ring
+ * @files_lock:	Protects @privdata, @files and the sensors of the files
+ */
+struct amd_sfh_ring {
+	struct kref kref;
+	struct miscdevice misc;
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	struct amd_sfh_ring_header *header;
+	struct amd_sfh_ring_entry *entries;
+	struct amd_sfh_data *privdata;
+	struct list_head files;
+	struct mutex files_lock;
+};
+
+/**
+ * struct amd_sfh_ring_file - Per open file data.
+ * @ring:	Sample ring
+ * @seen:	Head of the ring when poll() last reported readiness
+ * @sensors:	Bitmask of the sensor indices kept sampled by the file
+ * @node:	Entry in the ring's list of open files
+ */
+struct amd_sfh_ring_file {
+	struct amd_sfh_ring *ring;
+	u64 seen;
+	unsigned long sensors;
+	struct list_head node;
+};
+
+/**
+ * ring_sensor - Returns the HID device driver data of a firmware sensor.
+ * @privdata:	SFH driver data
+ * @sensor_idx:	Index of the sensor
+ *
+ * Returns NULL if the SFH does not serve the sensor.
+ */
+static struct amd_sfh_hid_data *ring_sensor(struct amd_sfh_data *privdata,
+					    unsigned int sensor_idx)
+{
+	int i;
+
+	for (i = 0; i < AMD_SFH_MAX_SENSORS; i++) {
+		if (privdata->sensors[i] &&
+		    privdata->sensors[i]->sensor_idx == sensor_idx)
+			return privdata->sensors[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * ring_put_sensors - Releases sensors kept sampled for the ring.
+ * @privdata:	SFH driver data
+ * @sensors:	Bitmask of sensor indices
+ */
+static void ring_put_sensors(struct amd_sfh_data *privdata,
+			     unsigned long sensors)
+{
+	unsigned int bit;
+
+	for_each_set_bit(bit, &sensors, BITS_PER_TYPE(u32))
+		amd_sfh_hid_ll_put(ring_sensor(privdata, bit));
+}
+
+/**
+ * ring_sample - Sets the sensors an open file keeps sampled.
+ * @ring_file:	Open file of the ring
+ * @sensors:	Bitmask of sensor indices
+ *
+ * Takes the added sensors before releasing the removed ones,
+ * so that sensors in both bitmasks keep running.
+ *
+ * Returns 0 on success or < zero on errors, in which case
+ * the file keeps the sensors it sampled before.
+ */
+static int ring_sample(struct amd_sfh_ring_file *ring_file, u32 sensors)
+{
+	struct amd_sfh_ring *ring = ring_file->ring;
+	unsigned long added, removed, taken = 0;
+	unsigned long requested = sensors;
+	struct amd_sfh_data *privdata;
+	unsigned int bit;
+	int rc = 0;
+
+	mutex_lock(&ring->files_lock);
+	privdata = ring->privdata;
+	if (!privdata) {
+		rc = -ENODEV;
+		goto out;
+	}
+
+	for_each_set_bit(bit, &requested, BITS_PER_TYPE(u32)) {
+		if (!ring_sensor(privdata, bit)) {
+			rc = -EINVAL;
+			goto out;
+		}
+	}
+
+	added = requested & ~ring_file->sensors;
+	removed = ring_file->sensors & ~requested;
+	for_each_set_bit(bit, &added, BITS_PER_TYPE(u32)) {
+		rc = amd_sfh_hid_ll_get(ring_sensor(privdata, bit));
+		if (rc) {
+			ring_put_sensors(privdata, taken);
+			goto out;
+		}
+
+		taken |= BIT(bit);
+	}
+
+	ring_put_sensors(privdata, removed);
+	ring_file->sensors = requested;
+out:
+	mutex_unlock(&ring->files_lock);
+	return rc;
+}
+
+static void ring_release(struct kref *kref)
+{
+	struct amd_sfh_ring *ring = container_of(kref, struct amd_sfh_ring,
+						 kref);
+
+	mutex_destroy(&ring->files_lock);
+	kfree(ring->misc.name);
+	vfree(ring->header);
+	kfree(ring);
+}
+
+static int ring_open(struct inode *inode, struct file *file)
+{
+	struct amd_sfh_ring *ring = container_of(file->private_data,
+						 struct amd_sfh_ring, misc);
+	struct amd_sfh_ring_file *ring_file;
+
+	ring_file = kzalloc(sizeof(*ring_file), GFP_KERNEL);
+	if (!ring_file)
+		return -ENOMEM;
+
+	kref_get(&ring->kref);
+	ring_file->ring = ring;
+	ring_file->seen = smp_load_acquire(&ring->header->head);
+	mutex_lock(&ring->files_lock);
+	list_add(&ring_file->node, &ring->files);
+	mutex_unlock(&ring->files_lock);
+	file->private_data = ring_file;
+	return 0;
+}
+
+static int ring_release_file(struct inode *inode, struct file *file)
+{
+	struct amd_sfh_ring_file *ring_file = file->private_data;
+	struct amd_sfh_ring *ring = ring_file->ring;
+
+	mutex_lock(&ring->files_lock);
+	if (ring->privdata)
+		ring_put_sensors(ring->privdata, ring_file->sensors);
+
+	list_del(&ring_file->node);
+	mutex_unlock(&ring->files_lock);
+	kref_put(&ring->kref, ring_release);
+	kfree(ring_file);
+	return 0;
+}
+
+static long ring_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	u32 sensors;
+
+	switch (cmd) {
+	case AMD_SFH_RING_SAMPLE:
+		if (get_user(sensors, (u32 __user *)arg))
+			return -EFAULT;
+
+		return ring_sample(file->private_data, sensors);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct amd_sfh_ring_file *ring_file = file->private_data;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, ring_file->ring->header,
+				   vma->vm_pgoff);
+}
+
+static __poll_t ring_poll(struct file *file, poll_table *wait)
+{
+	struct amd_sfh_ring_file *ring_file = file->private_data;
+	struct amd_sfh_ring *ring = ring_file->ring;
+	u64 head;
+
+	poll_wait(file, &ring->wait, wait);
+	head = smp_load_acquire(&ring->header->head);
+	if (head == ring_file->seen)
+		return 0;
+
+	ring_file->seen = head;
+	return EPOLLIN | EPOLLRDNORM;
+}
+
+static const struct file_operations ring_fops = {
+	.owner = THIS_MODULE,
+	.open = ring_open,
+	.release = ring_release_file,
+	.mmap = ring_mmap,
+	.poll = ring_poll,
+	.unlocked_ioctl = ring_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = noop_llseek,
+};
+
+/**
+ * amd_sfh_cdev_init - Registers the sample ring's character device.
+ * @privdata:	SFH driver data
+ *
+ * The ring is optional, so errors are only reported.
+ */
+void amd_sfh_cdev_init(struct amd_sfh_data *privdata)
+{
+	struct pci_dev *pci_dev = privdata->pci_dev;
+	size_t offset = PAGE_SIZE;
+	struct amd_sfh_ring *ring;
+	int rc = -ENOMEM;
+
+	BUILD_BUG_ON(sizeof(struct amd_sfh_ring_header) > PAGE_SIZE);
+	BUILD_BUG_ON(!is_power_of_2(AMD_SFH_RING_ENTRIES));
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		goto err;
+
+	ring->header = vmalloc_user(offset + AMD_SFH_RING_ENTRIES *
+				    sizeof(*ring->entries));
+	if (!ring->header)
+		goto free_ring;
+
+	ring->entries = (void *)ring->header + offset;
+	ring->header->version = AMD_SFH_RING_VERSION;
+	ring->header->entries = AMD_SFH_RING_ENTRIES;
+	ring->header->entry_size = sizeof(*ring->entries);
+	ring->header->entries_offset = offset;
+	kref_init(&ring->kref);
+	spin_lock_init(&ring->lock);
+	init_waitqueue_head(&ring->wait);
+	ring->privdata = privdata;
+	INIT_LIST_HEAD(&ring->files);
+	mutex_init(&ring->files_lock);
+
+	ring->misc.minor = MISC_DYNAMIC_MINOR;
+	ring->misc.name = kasprintf(GFP_KERNEL, "amd_sfh-%s",
+				    pci_name(pci_dev));
+	ring->misc.fops = &ring_fops;
+	ring->misc.parent = &pci_dev->dev;
+	if (!ring->misc.name)
+		goto free_ring;
+
+	rc = misc_register(&ring->misc);
+	if (rc)
+		goto free_ring;
+
+	privdata->ring = ring;
+	return;
+
+free_ring:
+	ring_release(&ring->kref);
+err:
+	pci_warn(pci_dev, "Failed to register sample ring: %d\n", rc);
+}
+
+/**
+ * amd_sfh_cdev_deinit - Unregisters the sample ring's character device.
+ * @privdata:	SFH driver data
+ *
+ * Must be called before the sensors are removed, since it releases the
+ * sensors kept sampled by open files, and after interrupts are disabled.
+ * The ring itself is freed once the last reader closed and unmapped it.
+ */
+void amd_sfh_cdev_deinit(struct amd_sfh_data *privdata)
+{
+	struct amd_sfh_ring *ring = privdata->ring;
+	struct amd_sfh_ring_file *ring_file;
+
+	if (!ring)
+		return;
+
+	/* Wait for a running poll to finish its writes to the ring */
+	WRITE_ONCE(privdata->ring, NULL);
+	amd_sfh_sched_sync(privdata);
+	misc_deregister(&ring->misc);
+
+	mutex_lock(&ring->files_lock);
+	list_for_each_entry(ring_file, &ring->files, node) {
+		ring_put_sensors(privdata, ring_file->sensors);
+		ring_file->sensors = 0;
+	}
+
+	ring->privdata = NULL;
+	mutex_unlock(&ring->files_lock);
+	kref_put(&ring->kref, ring_release);
+}
+
+/**
+ * amd_sfh_cdev_push - Writes a sample to the sample ring.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ */
+void amd_sfh_cdev_push(struct amd_sfh_hid_data *hid_data,
+		       const struct sensor_sample *sample)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_ring *ring = READ_ONCE(privdata->ring);
+	struct amd_sfh_ring_entry *entry;
+	u64 seq;
+
+	if (!ring)
+		return;
+
+	spin_lock(&ring->lock);
+	seq = ring->header->head;
+	entry = &ring->entries[seq & (AMD_SFH_RING_ENTRIES - 1)];
+	WRITE_ONCE(entry->seq, U64_MAX);
+	smp_wmb();
+	entry->timestamp = sample->timestamp;
+	entry->sensor_idx = hid_data->sensor_idx;
+	entry->count = sample->count;
+	memcpy(entry->values, sample->values, sizeof(entry->values));
+	smp_wmb();
+	WRITE_ONCE(entry->seq, seq);
+	smp_store_release(&ring->header->head, seq + 1);
+	spin_unlock(&ring->lock);
+
+	if (wq_has_sleeper(&ring->wait))
+		wake_up_interruptible(&ring->wait);
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub sample ring interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_CDEV_H
+#define AMD_SFH_CDEV_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define AMD_SFH_RING_VERSION	1
+#define AMD_SFH_RING_ENTRIES	1024
+
+/*
+ * Keeps the sensors of a __u32 bitmask of sensor indices, as in the sensor
+ * mask, sampled while the file is open. Sensors missing from a later
+ * bitmask are released. Only sensors of the firmware can be requested.
+ */
+#define AMD_SFH_RING_SAMPLE	_IOW('S', 0x01, __u32)
+
+/**
+ * struct amd_sfh_ring_header - Header of the mmap()ed sample ring.
+ * @version:		Layout version of the ring
+ * @entries:		Amount of entries in the ring, a power of two
+ * @entry_size:		Size of an entry in bytes
+ * @entries_offset:	Offset of the first entry from the header
+ * @head:		Sequence number of the next entry to be written
+ *
+ * The entry with sequence number n is located at index n % entries.
+ * A reader that falls behind by more than the amount of entries
+ * has lost samples.
+ */
+struct amd_sfh_ring_header {
+	__u32 version;
+	__u32 entries;
+	__u32 entry_size;
+	__u32 entries_offset;
+	__u64 head;
+};
+
+/**
+ * struct amd_sfh_ring_entry - Sample in the mmap()ed sample ring.
+ * @seq:	Sequence number of the entry or all ones while it is written
+ * @timestamp:	CLOCK_BOOTTIME of the sample in nanoseconds
+ * @sensor_idx:	Index of the sensor that produced the sample
+ * @count:	Amount of valid values
+ * @values:	Values of the sample as reported to the host
+ *
+ * Readers must read @seq before and after copying an entry
+ * and discard the copy unless both match the expected sequence number.
+ */
+struct amd_sfh_ring_entry {
+	__u64 seq;
+	__u64 timestamp;
+	__u32 sensor_idx;
+	__u32 count;
+	__s32 values[AMD_SFH_MAX_AXES];
+};
+
+void amd_sfh_cdev_init(struct amd_sfh_data *privdata);
+void amd_sfh_cdev_deinit(struct amd_sfh_data *privdata);
+void amd_sfh_cdev_push(struct amd_sfh_hid_data *hid_data,
+		       const struct sensor_sample *sample);
+
+#endif
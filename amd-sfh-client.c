@@ -6,92 +6,128 @@
  *		Richard Neumann <mail@richard-neumann.de>
  */
 
+#include <linux/async.h>
 #include <linux/hid.h>
+#include <linux/mutex.h>
 #include <linux/pci.h>
 #include <linux/slab.h>
 #include <linux/types.h>
 
 #include "amd-sfh.h"
 #include "amd-sfh-client.h"
+#include "amd-sfh-fusion.h"
 #include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-iio.h"
+#include "amd-sfh-input.h"
 #include "amd-sfh-pci.h"
+#include "sensors/amd-sfh-sensors.h"
 
 #define AMD_SFH_HID_VENDOR	0x3fe
 #define AMD_SFH_HID_PRODUCT	0x0001
 #define AMD_SFH_HID_VERSION	0x0001
 #define AMD_SFH_PHY_DEV		"AMD Sensor Fusion Hub (PCIe)"
 
+/* Registrations of the sensors' devices running in parallel */
+static ASYNC_DOMAIN_EXCLUSIVE(amd_sfh_async_domain);
+
+/* The sensor types supported by the SFH, virtual sensors last */
+static const struct amd_sfh_sensor_ops *sensor_ops[AMD_SFH_MAX_DEVICES] = {
+	&amd_sfh_accel_ops,
+	&amd_sfh_gyro_ops,
+	&amd_sfh_mag_ops,
+	&amd_sfh_lid_ops,
+	&amd_sfh_als_ops,
+	&amd_sfh_orient_ops,
+	&amd_sfh_gravity_ops,
+	&amd_sfh_linear_accel_ops,
+	&amd_sfh_screen_ops,
+};
+
 /**
- * get_sensor_name - Returns the name of a sensor by its index.
- * @sensor_idx:	The sensor's index
+ * sensor_present - Checks whether the SFH serves a sensor.
+ * @privdata:		SFH driver data
+ * @sensor_mask:	Bitmask of the sensors connected to the SFH
+ * @ops:		Sensor type
  *
- * Returns the name of the respective sensor.
+ * Virtual sensors are present if all of their sources are.
  */
-static char *get_sensor_name(enum sensor_idx sensor_idx)
+static bool sensor_present(struct amd_sfh_data *privdata, uint sensor_mask,
+			   const struct amd_sfh_sensor_ops *ops)
 {
-	switch (sensor_idx) {
-	case ACCEL_IDX:
-		return "accelerometer";
-	case GYRO_IDX:
-		return "gyroscope";
-	case MAG_IDX:
-		return "magnetometer";
-	case LID_IDX:
-		return "lid switch";
-	case ALS_IDX:
-		return "ambient light sensor";
-	default:
-		return "unknown sensor type";
-	}
+	if (!ops->sources)
+		return sensor_mask & BIT(ops->sensor_idx);
+
+	return privdata->fusion &&
+	       (sensor_mask & ops->sources) == ops->sources;
 }
 
 /**
  * get_hid_data - Allocate and initialize HID device driver data.
- * @hid:		HID device
  * @privdata:		SFH driver data
- * @sensor_idx:		Sensor index
+ * @ops:		Sensor type
  *
+ * Claims the sensor's slots of the SFH's DMA memory, which the firmware
+ * writes as long as the sensor is sampled. They are kept until the
+ * client is torn down, so that the sensor can be sampled regardless
+ * of the device bound to it. Virtual sensors do not need any.
  * Returns a pointer to the HID driver data on success or an ERR_PTR on error.
  */
-static struct amd_sfh_hid_data *get_hid_data(struct hid_device *hid,
-					     struct amd_sfh_data *privdata,
-					     enum sensor_idx sensor_idx)
+static struct amd_sfh_hid_data *
+get_hid_data(struct amd_sfh_data *privdata,
+	     const struct amd_sfh_sensor_ops *ops)
 {
 	struct amd_sfh_hid_data *hid_data;
+	int i;
 
 	hid_data = devm_kzalloc(&privdata->pci_dev->dev, sizeof(*hid_data),
 				GFP_KERNEL);
 	if (!hid_data)
 		return ERR_PTR(-ENOMEM);
 
-	hid_data->hid = hid;
 	hid_data->pci_dev = privdata->pci_dev;
 	hid_data->version = privdata->version;
-	hid_data->sensor_idx = sensor_idx;
-	hid_data->cpu_addr = NULL;
+	hid_data->sensor_idx = ops->sensor_idx;
+	hid_data->ops = ops;
+	if (!ops->sources) {
+		hid_data->cpu_addr =
+			amd_sfh_get_dma_slots(privdata->pci_dev,
+					      &hid_data->dma_handle);
+		if (!hid_data->cpu_addr) {
+			devm_kfree(&privdata->pci_dev->dev, hid_data);
+			return ERR_PTR(-ENOSPC);
+		}
+	}
+
+	INIT_LIST_HEAD(&hid_data->sched_node);
+	INIT_KFIFO(hid_data->fifo);
+	mutex_init(&hid_data->lock);
+	mutex_init(&hid_data->fifo_lock);
+	hid_data->settings.report_interval = AMD_SFH_UPDATE_INTERVAL;
+	hid_data->settings.report_state = AMD_SFH_REPORT_STATE;
+
+	for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+		hid_data->settings.sensitivity[i] = AMD_SFH_DEFAULT_SENSITIVITY;
 
 	return hid_data;
 }
 
 /**
  * get_hid_device - Creates a HID device for a sensor on th SFH.
- * @privdata:		SFH driver data
- * @sensor_idx:		Sensor index
+ * @hid_data:		HID device driver data
  *
- * Sets up the HID device and the corresponding HID driver data.
- * Returns a pointer to the new HID device or NULL on errors.
+ * Sets up the HID device serving the sensor of the HID driver data.
+ * Returns 0 on success and non-zero on errors.
  */
-static struct hid_device *get_hid_device(struct amd_sfh_data *privdata,
-					 enum sensor_idx sensor_idx)
+static int get_hid_device(struct amd_sfh_hid_data *hid_data)
 {
 	struct hid_device *hid;
 	int rc;
 
 	hid = hid_allocate_device();
 	if (IS_ERR(hid)) {
-		pci_err(privdata->pci_dev, "HID device allocation returned: %ld",
+		pci_err(hid_data->pci_dev, "HID device allocation returned: %ld",
 			PTR_ERR(hid));
-		goto err_hid_alloc;
+		return PTR_ERR(hid);
 	}
 
 	hid->bus = BUS_I2C;
@@ -101,36 +137,83 @@ static struct hid_device *get_hid_device(struct amd_sfh_data *privdata,
 	hid->version = AMD_SFH_HID_VERSION;
 	hid->type = HID_TYPE_OTHER;
 	hid->ll_driver = &amd_sfh_hid_ll_driver;
+	hid->driver_data = hid_data;
+	hid_data->hid = hid;
 
 	rc = strscpy(hid->phys, AMD_SFH_PHY_DEV, sizeof(hid->phys));
 	if (rc >= sizeof(hid->phys))
 		hid_warn(hid, "Could not set HID device location.\n");
 
-	rc = strscpy(hid->name, get_sensor_name(sensor_idx), sizeof(hid->name));
+	rc = strscpy(hid->name, hid_data->ops->name, sizeof(hid->name));
 	if (rc >= sizeof(hid->name))
 		hid_warn(hid, "Could not set HID device name.\n");
 
-	hid->driver_data = get_hid_data(hid, privdata, sensor_idx);
-	if (IS_ERR(hid->driver_data)) {
-		hid_err(hid, "HID data allocation returned: %ld",
-			PTR_ERR(hid->driver_data));
-		goto destroy_hid_device;
-	}
-
 	rc = hid_add_device(hid);
 	if (rc)	{
 		hid_err(hid, "Failed to add HID device: %d\n", rc);
-		goto free_hid_data;
+		hid_destroy_device(hid);
+		hid_data->hid = NULL;
+		return rc;
 	}
 
-	return hid;
+	return 0;
+}
+
+/**
+ * add_sensor - Registers the device serving a sensor on the SFH.
+ * @data:	HID device driver data
+ * @cookie:	Cookie of the registration
+ *
+ * Serves the lid switch through the input backend, other sensors
+ * through the IIO backend if it is enabled and supports the sensor,
+ * and through a HID device otherwise.
+ * Runs asynchronously, so that the sensors are registered in parallel.
+ * Virtual sensors and the lid switch use the sensors before them in
+ * sensor_ops, so they wait for the registration of those first.
+ */
+static void add_sensor(void *data, async_cookie_t cookie)
+{
+	struct amd_sfh_hid_data *hid_data = data;
+	int rc;
+
+	if (hid_data->ops->sources ||
+	    amd_sfh_input_supported(hid_data->sensor_idx))
+		async_synchronize_cookie_domain(cookie, &amd_sfh_async_domain);
+
+	if (amd_sfh_input_supported(hid_data->sensor_idx))
+		rc = amd_sfh_input_init(hid_data);
+	else if (amd_sfh_iio_supported(hid_data->sensor_idx))
+		rc = amd_sfh_iio_init(hid_data);
+	else
+		rc = get_hid_device(hid_data);
+
+	if (rc)
+		pci_err(hid_data->pci_dev, "Failed to add %s: %d\n",
+			hid_data->ops->name, rc);
+}
+
+/**
+ * get_sensor - Creates the device serving a sensor on the SFH.
+ * @privdata:		SFH driver data
+ * @ops:		Sensor type
+ *
+ * Schedules the registration of the sensor's device.
+ * Returns a pointer to the HID device driver data or NULL on errors.
+ */
+static struct amd_sfh_hid_data *
+get_sensor(struct amd_sfh_data *privdata, const struct amd_sfh_sensor_ops *ops)
+{
+	struct amd_sfh_hid_data *hid_data;
+
+	hid_data = get_hid_data(privdata, ops);
+	if (IS_ERR(hid_data)) {
+		pci_err(privdata->pci_dev, "HID data allocation returned: %ld",
+			PTR_ERR(hid_data));
+		return NULL;
+	}
 
-free_hid_data:
-	devm_kfree(&privdata->pci_dev->dev, hid->driver_data);
-destroy_hid_device:
-	hid_destroy_device(hid);
-err_hid_alloc:
-	return NULL;
+	async_schedule_domain(add_sensor, hid_data, &amd_sfh_async_domain);
+	return hid_data;
 }
 
 /**
@@ -141,53 +224,117 @@ err_hid_alloc:
  * from amd_sfh_get_sensor_mask().
  * In case of a match, it instantiates a corresponding HID device
  * to process the respective sensor's data.
+ * Virtual sensors are instantiated if all of their sources match.
+ * The devices are registered asynchronously, off the probe's critical path.
  */
 void amd_sfh_client_init(struct amd_sfh_data *privdata)
 {
 	struct pci_dev *pci_dev = privdata->pci_dev;
 	uint sensor_mask = amd_sfh_get_sensor_mask(pci_dev);
-	int i = 0;
-
-	if (sensor_mask & ACCEL_MASK)
-		privdata->sensors[i++] = get_hid_device(privdata, ACCEL_IDX);
-	else
-		privdata->sensors[i++] = NULL;
-
-	if (sensor_mask & GYRO_MASK)
-		privdata->sensors[i++] = get_hid_device(privdata, GYRO_IDX);
-	else
-		privdata->sensors[i++] = NULL;
+	int i, rc;
 
-	if (sensor_mask & MAG_MASK)
-		privdata->sensors[i++] = get_hid_device(privdata, MAG_IDX);
-	else
-		privdata->sensors[i++] = NULL;
-
-	if (sensor_mask & LID_MASK)
-		privdata->sensors[i++] = get_hid_device(privdata, LID_IDX);
-	else
-		privdata->sensors[i++] = NULL;
+	rc = amd_sfh_fusion_init(privdata);
+	if (rc)
+		pci_warn(pci_dev, "Virtual sensors unavailable: %d\n", rc);
 
-	if (sensor_mask & ALS_MASK)
-		privdata->sensors[i++] = get_hid_device(privdata, ALS_IDX);
-	else
-		privdata->sensors[i++] = NULL;
+	for (i = 0; i < AMD_SFH_MAX_DEVICES; i++) {
+		if (sensor_present(privdata, sensor_mask, sensor_ops[i]))
+			privdata->sensors[i] = get_sensor(privdata,
+							  sensor_ops[i]);
+		else
+			privdata->sensors[i] = NULL;
+	}
 }
 
 /**
  * amd_sfh_client_deinit - Removes all active HID devices.
  * @privdata:	Driver data
  *
- * Destroys all initialized HID devices.
+ * Waits for pending registrations and destroys
+ * all initialized HID, IIO and input devices.
+ * Virtual sensors are destroyed before the sensors they use.
+ * The DMA slots are released once no user can sample a sensor anymore.
  */
 void amd_sfh_client_deinit(struct amd_sfh_data *privdata)
 {
+	struct amd_sfh_hid_data *hid_data;
+	int i;
+
+	async_synchronize_full_domain(&amd_sfh_async_domain);
+	for (i = AMD_SFH_MAX_DEVICES - 1; i >= 0; i--) {
+		hid_data = privdata->sensors[i];
+		if (!hid_data)
+			continue;
+
+		if (hid_data->indio_dev)
+			amd_sfh_iio_deinit(hid_data);
+		else if (hid_data->input)
+			amd_sfh_input_deinit(hid_data);
+		else if (hid_data->hid)
+			hid_destroy_device(hid_data->hid);
+
+		if (hid_data->cpu_addr)
+			amd_sfh_put_dma_slots(hid_data->pci_dev,
+					      hid_data->cpu_addr);
+
+		mutex_destroy(&hid_data->fifo_lock);
+		mutex_destroy(&hid_data->lock);
+		privdata->sensors[i] = NULL;
+	}
+}
+
+/**
+ * amd_sfh_client_report - Delivers reports of sensors with new data.
+ * @privdata:		SFH driver data
+ * @sensor_mask:	Bitmask of the sensors which signalled new data
+ * @due:		Time at which the new data was signalled
+ *
+ * Pushes an input report for every HID device whose sensor
+ * is contained in the given bitmask.
+ * Virtual sensors are updated along with their sources.
+ */
+void amd_sfh_client_report(struct amd_sfh_data *privdata, uint sensor_mask,
+			   ktime_t due)
+{
+	struct amd_sfh_hid_data *hid_data;
 	int i;
 
 	for (i = 0; i < AMD_SFH_MAX_SENSORS; i++) {
+		hid_data = privdata->sensors[i];
+		if (hid_data && sensor_mask & BIT(hid_data->sensor_idx))
+			amd_sfh_hid_ll_report(hid_data, due);
+	}
+}
+
+/**
+ * amd_sfh_client_suspend - Prepares all sensors for system sleep.
+ * @privdata:	SFH driver data
+ *
+ * Waits for pending registrations first.
+ */
+void amd_sfh_client_suspend(struct amd_sfh_data *privdata)
+{
+	int i;
+
+	async_synchronize_full_domain(&amd_sfh_async_domain);
+	for (i = 0; i < AMD_SFH_MAX_DEVICES; i++) {
 		if (privdata->sensors[i])
-			hid_destroy_device(privdata->sensors[i]);
+			amd_sfh_hid_ll_suspend(privdata->sensors[i]);
+	}
+}
 
-		privdata->sensors[i] = NULL;
+/**
+ * amd_sfh_client_resume - Restores all sensors after system sleep.
+ * @privdata:	SFH driver data
+ *
+ * Only the sensors which were open on suspend are restarted.
+ */
+void amd_sfh_client_resume(struct amd_sfh_data *privdata)
+{
+	int i;
+
+	for (i = 0; i < AMD_SFH_MAX_DEVICES; i++) {
+		if (privdata->sensors[i])
+			amd_sfh_hid_ll_resume(privdata->sensors[i]);
 	}
 }
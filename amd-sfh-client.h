@@ -9,11 +9,16 @@
 #ifndef AMD_SFH_CLIENT_H
 #define AMD_SFH_CLIENT_H
 
+#include <linux/ktime.h>
 #include <linux/pci.h>
 
 #include "amd-sfh.h"
 
 void amd_sfh_client_init(struct amd_sfh_data *privdata);
 void amd_sfh_client_deinit(struct amd_sfh_data *privdata);
+void amd_sfh_client_report(struct amd_sfh_data *privdata, uint sensor_mask,
+			   ktime_t due);
+void amd_sfh_client_suspend(struct amd_sfh_data *privdata);
+void amd_sfh_client_resume(struct amd_sfh_data *privdata);
 
 #endif
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub debugfs interface
+ *
+ * Exposes the mailbox counters of each SFH in
+ * /sys/kernel/debug/amd_sfh-<PCI device>/ and the
+ * performance counters of each sensor in
+ * /sys/kernel/debug/amd_sfh-<PCI device>/<sensor>/.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/debugfs.h>
+#include <linux/pci.h>
+#include <linux/seq_file.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-debugfs.h"
+#include "amd-sfh-hid-ll-drv.h"
+
+/**
+ * hist_show - Shows a log2 histogram.
+ * @m:		Sequence file holding the histogram
+ * @v:		Unused
+ *
+ * Prints one line per bucket, holding the bucket's lower
+ * bound in nanoseconds and the amount of recorded values.
+ */
+static int hist_show(struct seq_file *m, void *v)
+{
+	u64 *hist = m->private;
+	int i;
+
+	for (i = 0; i < AMD_SFH_HIST_BUCKETS; i++)
+		seq_printf(m, "%llu %llu\n", i ? BIT_ULL(i) : 0, hist[i]);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hist);
+
+/**
+ * amd_sfh_debugfs_init - Creates the debugfs directory of the SFH.
+ * @privdata:	SFH driver data
+ */
+void amd_sfh_debugfs_init(struct amd_sfh_data *privdata)
+{
+	struct amd_sfh_cmd_stats *stats = &privdata->cmd_stats;
+	struct dentry *dir;
+	char name[32];
+
+	snprintf(name, sizeof(name), "amd_sfh-%s", pci_name(privdata->pci_dev));
+	dir = debugfs_create_dir(name, NULL);
+	debugfs_create_u64("commands", 0444, dir, &stats->commands);
+	debugfs_create_u64("command_retries", 0444, dir, &stats->retries);
+	debugfs_create_u64("command_timeouts", 0444, dir, &stats->timeouts);
+	debugfs_create_file("command_latency", 0444, dir, stats->latency,
+			    &hist_fops);
+	debugfs_create_x32("interrupt_status", 0444, dir,
+			   &privdata->irq_seen);
+	privdata->debugfs = dir;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_debugfs_init);
+
+/**
+ * amd_sfh_debugfs_deinit - Removes the debugfs directory of the SFH.
+ * @privdata:	SFH driver data
+ */
+void amd_sfh_debugfs_deinit(struct amd_sfh_data *privdata)
+{
+	debugfs_remove_recursive(privdata->debugfs);
+	privdata->debugfs = NULL;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_debugfs_deinit);
+
+/**
+ * amd_sfh_debugfs_add - Creates the debugfs directory of a sensor.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_debugfs_add(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_stats *stats = &hid_data->stats;
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(hid_data->ops->debugfs_name,
+				 privdata->debugfs);
+	debugfs_create_u64("samples", 0444, dir, &stats->samples);
+	debugfs_create_u64("duplicates", 0444, dir, &stats->duplicates);
+	debugfs_create_u64("missed", 0444, dir, &stats->missed);
+	debugfs_create_u64("errors", 0444, dir, &stats->errors);
+	debugfs_create_u64("poll_elapsed_ns", 0444, dir,
+			   &stats->poll_elapsed_ns);
+	debugfs_create_u64("request_elapsed_ns", 0444, dir,
+			   &stats->request_elapsed_ns);
+	debugfs_create_u64("resume_ns", 0444, dir, &stats->resume_ns);
+	debugfs_create_file("latency", 0444, dir, stats->latency,
+			    &hist_fops);
+	debugfs_create_file("interval", 0444, dir, stats->interval,
+			    &hist_fops);
+	hid_data->debugfs = dir;
+}
+
+/**
+ * amd_sfh_debugfs_remove - Removes the debugfs directory of a sensor.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_debugfs_remove(struct amd_sfh_hid_data *hid_data)
+{
+	debugfs_remove_recursive(hid_data->debugfs);
+	hid_data->debugfs = NULL;
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub debugfs interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_DEBUGFS_H
+#define AMD_SFH_DEBUGFS_H
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+
+void amd_sfh_debugfs_init(struct amd_sfh_data *privdata);
+void amd_sfh_debugfs_deinit(struct amd_sfh_data *privdata);
+void amd_sfh_debugfs_add(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_debugfs_remove(struct amd_sfh_hid_data *hid_data);
+
+#endif
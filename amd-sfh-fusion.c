@@ -0,0 +1,768 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub virtual sensors
+ *
+ * Computes virtual sensors from the samples of the physical sensors
+ * as they are read, so that consumers do not need to fuse separately
+ * delivered streams themselves.
+ * The device orientation is tracked by a Mahony complementary filter,
+ * which integrates the gyroscope and corrects its drift towards the
+ * directions of gravity and of the magnetic field.
+ * Gravity is the low-passed accelerometer or, if a gyroscope is present,
+ * the direction of gravity estimated by that filter, scaled to the
+ * low-passed magnitude. The linear acceleration is the remainder.
+ * The screen orientation changes once the accelerometer stayed closer
+ * than 45 degrees minus a hysteresis to another axis for a settle time.
+ * All computations use fixed point arithmetic.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/bitops.h>
+#include <linux/fixp-arith.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/pci.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/time64.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-fusion.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define FUSION_SHIFT		28
+#define FUSION_ONE		(1LL << FUSION_SHIFT)
+#define FUSION_HALF		(FUSION_ONE / 2)
+
+/* pi / 18000 converts the gyroscope's centidegrees to radians */
+#define FUSION_RAD_PER_CDEG	46850
+#define FUSION_MAX_RATE		(64 * FUSION_ONE)
+
+/* Doubled proportional gains, raised until the filter settled */
+#define FUSION_TWO_KP		FUSION_ONE
+#define FUSION_TWO_KP_SETTLE	(10 * FUSION_ONE)
+#define FUSION_SETTLE_NS	NSEC_PER_SEC
+#define FUSION_MAX_DT_NS	NSEC_PER_SEC
+
+/* Time constant of the gravity low-pass filter and its fraction bits */
+#define FUSION_GRAVITY_TAU_NS	(200 * NSEC_PER_MSEC)
+#define FUSION_LP_SHIFT		16
+
+/* Screens tilted by less than asin(1 / sqrt(8)), about 21 degrees, lie flat */
+#define FUSION_SCREEN_MAX_HYST	40
+#define FUSION_SCREEN_FLAT_DIV	8
+
+/* Scale of the quaternion's components as written by the firmware */
+#define FUSION_QUAT_SCALE	(10000 * AMD_SFH_FW_MUL)
+
+static unsigned int fusion_screen_hysteresis = 15;
+module_param_named(screen_hysteresis, fusion_screen_hysteresis, uint, 0644);
+MODULE_PARM_DESC(screen_hysteresis,
+		 "tilt in degrees past 45 to change the screen orientation");
+
+static unsigned int fusion_screen_settle_ms = 300;
+module_param_named(screen_settle_ms, fusion_screen_settle_ms, uint, 0644);
+MODULE_PARM_DESC(screen_settle_ms,
+		 "milliseconds until a screen orientation change is reported");
+
+/**
+ * struct amd_sfh_fusion - State of the virtual sensors of an SFH.
+ * @lock:	Serializes updates, resets and reads of the state
+ * @quat:	Device orientation quaternion in W, X, Y, Z order
+ * @accel:	Last sample of the accelerometer
+ * @mag:	Last sample of the magnetometer
+ * @has_accel:	Whether @accel is valid
+ * @has_mag:	Whether @mag is valid
+ * @gyro_time:	Timestamp of the last sample of the gyroscope or zero
+ * @settle_time: Timestamp of the first sample of the gyroscope
+ * @accel_time:	Timestamp of the last sample of the accelerometer or zero
+ * @lowpass:	Low-passed accelerometer with FUSION_LP_SHIFT fraction bits
+ * @gravity:	Last computed gravity in units of the accelerometer
+ * @screen:	Reported screen orientation
+ * @has_screen:	Whether @screen is valid
+ * @screen_next: Screen orientation waiting to settle
+ * @screen_time: Timestamp since which @screen_next lasts or zero
+ */
+struct amd_sfh_fusion {
+	spinlock_t lock;
+	s64 quat[4];
+	int accel[3];
+	int mag[3];
+	bool has_accel;
+	bool has_mag;
+	u64 gyro_time;
+	u64 settle_time;
+	u64 accel_time;
+	s64 lowpass[3];
+	int gravity[3];
+	enum amd_sfh_screen screen;
+	bool has_screen;
+	enum amd_sfh_screen screen_next;
+	u64 screen_time;
+};
+
+/**
+ * fmul - Multiplies two fixed point numbers.
+ * @a:	Factor
+ * @b:	Factor
+ */
+static inline s64 fmul(s64 a, s64 b)
+{
+	return (a * b) >> FUSION_SHIFT;
+}
+
+/**
+ * fusion_normalize - Scales a vector to unit length.
+ * @v:		Vector to scale
+ * @n:		Amount of components
+ *
+ * The components may be of any scale, as long as they fit into an int
+ * or are fixed point numbers of about unit length.
+ * Returns false if the vector has no direction.
+ */
+static bool fusion_normalize(s64 *v, unsigned int n)
+{
+	u64 sum = 0;
+	u32 norm;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		sum += (u64)(v[i] * v[i]);
+
+	norm = int_sqrt64(sum);
+	if (!norm)
+		return false;
+
+	for (i = 0; i < n; i++)
+		v[i] = div64_s64(v[i] * FUSION_ONE, norm);
+
+	return true;
+}
+
+/**
+ * fusion_rate - Converts a gyroscope value to radians per second.
+ * @value:	Sample value of the gyroscope
+ */
+static s64 fusion_rate(int value)
+{
+	s64 rate = (s64)value * FUSION_RAD_PER_CDEG;
+
+	if (amd_sfh_high_precision)
+		rate = div_s64(rate, AMD_SFH_FW_MUL);
+
+	return clamp_t(s64, rate, -FUSION_MAX_RATE, FUSION_MAX_RATE);
+}
+
+/**
+ * fusion_reset_screen - Forgets the screen orientation.
+ * @fusion:	Virtual sensors state
+ *
+ * Must be called with the state's lock held.
+ */
+static void fusion_reset_screen(struct amd_sfh_fusion *fusion)
+{
+	fusion->screen = AMD_SFH_SCREEN_NORMAL;
+	fusion->has_screen = false;
+	fusion->screen_time = 0;
+}
+
+/**
+ * fusion_reset - Resets the state to the identity orientation.
+ * @fusion:	Virtual sensors state
+ *
+ * Must be called with the state's lock held.
+ */
+static void fusion_reset(struct amd_sfh_fusion *fusion)
+{
+	memset(fusion->quat, 0, sizeof(fusion->quat));
+	fusion->quat[0] = FUSION_ONE;
+	fusion->has_accel = false;
+	fusion->has_mag = false;
+	fusion->gyro_time = 0;
+	fusion->settle_time = 0;
+	fusion->accel_time = 0;
+	memset(fusion->gravity, 0, sizeof(fusion->gravity));
+	fusion_reset_screen(fusion);
+}
+
+/**
+ * fusion_error - Computes the error of the estimated orientation.
+ * @q:		Orientation quaternion
+ * @a:		Measured direction of gravity, as unit vector
+ * @m:		Measured direction of the magnetic field or NULL
+ * @e:		Returns half the error as rotation vector
+ *
+ * The error is the cross product of the measured directions
+ * and the directions estimated from the orientation.
+ */
+static void fusion_error(const s64 *q, const s64 *a, const s64 *m, s64 *e)
+{
+	s64 q0q0 = fmul(q[0], q[0]), q0q1 = fmul(q[0], q[1]);
+	s64 q0q2 = fmul(q[0], q[2]), q0q3 = fmul(q[0], q[3]);
+	s64 q1q1 = fmul(q[1], q[1]), q1q2 = fmul(q[1], q[2]);
+	s64 q1q3 = fmul(q[1], q[3]), q2q2 = fmul(q[2], q[2]);
+	s64 q2q3 = fmul(q[2], q[3]), q3q3 = fmul(q[3], q[3]);
+	s64 v[3], w[3], hx, hy, bx, bz;
+
+	/* Estimated direction of gravity, halved */
+	v[0] = q1q3 - q0q2;
+	v[1] = q0q1 + q2q3;
+	v[2] = q0q0 - FUSION_HALF + q3q3;
+
+	e[0] = fmul(a[1], v[2]) - fmul(a[2], v[1]);
+	e[1] = fmul(a[2], v[0]) - fmul(a[0], v[2]);
+	e[2] = fmul(a[0], v[1]) - fmul(a[1], v[0]);
+	if (!m)
+		return;
+
+	/* Reference direction of the magnetic field in the earth frame */
+	hx = 2 * (fmul(m[0], FUSION_HALF - q2q2 - q3q3) +
+		  fmul(m[1], q1q2 - q0q3) + fmul(m[2], q1q3 + q0q2));
+	hy = 2 * (fmul(m[0], q1q2 + q0q3) +
+		  fmul(m[1], FUSION_HALF - q1q1 - q3q3) +
+		  fmul(m[2], q2q3 - q0q1));
+	bx = int_sqrt64((u64)(hx * hx) + (u64)(hy * hy));
+	bz = 2 * (fmul(m[0], q1q3 - q0q2) + fmul(m[1], q2q3 + q0q1) +
+		  fmul(m[2], FUSION_HALF - q1q1 - q2q2));
+
+	/* Estimated direction of the magnetic field, halved */
+	w[0] = fmul(bx, FUSION_HALF - q2q2 - q3q3) + fmul(bz, q1q3 - q0q2);
+	w[1] = fmul(bx, q1q2 - q0q3) + fmul(bz, q0q1 + q2q3);
+	w[2] = fmul(bx, q0q2 + q1q3) + fmul(bz, FUSION_HALF - q1q1 - q2q2);
+
+	e[0] += fmul(m[1], w[2]) - fmul(m[2], w[1]);
+	e[1] += fmul(m[2], w[0]) - fmul(m[0], w[2]);
+	e[2] += fmul(m[0], w[1]) - fmul(m[1], w[0]);
+}
+
+/**
+ * fusion_update - Advances the orientation by a gyroscope sample.
+ * @fusion:	Virtual sensors state
+ * @gyro:	Sample of the gyroscope
+ *
+ * Must be called with the state's lock held.
+ * The accelerometer reports the acceleration of gravity, i.e. it points
+ * downwards, while the filter expects the reaction to it.
+ */
+static void fusion_update(struct amd_sfh_fusion *fusion,
+			  const struct sensor_sample *gyro)
+{
+	s64 *q = fusion->quat;
+	s64 a[3], m[3], g[3], e[3] = { 0 };
+	s64 dt, dt_us, two_kp, qa, qb, qc;
+	int i;
+
+	if (!fusion->gyro_time) {
+		fusion->gyro_time = gyro->timestamp;
+		fusion->settle_time = gyro->timestamp;
+		return;
+	}
+
+	dt = gyro->timestamp - fusion->gyro_time;
+	fusion->gyro_time = gyro->timestamp;
+	if (dt <= 0)
+		return;
+
+	dt_us = div_s64(min_t(s64, dt, FUSION_MAX_DT_NS), NSEC_PER_USEC);
+	for (i = 0; i < 3; i++) {
+		a[i] = -(s64)fusion->accel[i];
+		m[i] = fusion->mag[i];
+		g[i] = fusion_rate(gyro->values[i]);
+	}
+
+	if (fusion->has_accel && fusion_normalize(a, 3)) {
+		if (fusion->has_mag && fusion_normalize(m, 3))
+			fusion_error(q, a, m, e);
+		else
+			fusion_error(q, a, NULL, e);
+	}
+
+	two_kp = FUSION_TWO_KP;
+	if (gyro->timestamp - fusion->settle_time < FUSION_SETTLE_NS)
+		two_kp = FUSION_TWO_KP_SETTLE;
+
+	for (i = 0; i < 3; i++) {
+		g[i] += fmul(two_kp, e[i]);
+		g[i] = div_s64(g[i] * dt_us, 2 * USEC_PER_SEC);
+	}
+
+	qa = q[0];
+	qb = q[1];
+	qc = q[2];
+	q[0] += -fmul(qb, g[0]) - fmul(qc, g[1]) - fmul(q[3], g[2]);
+	q[1] += fmul(qa, g[0]) + fmul(qc, g[2]) - fmul(q[3], g[1]);
+	q[2] += fmul(qa, g[1]) - fmul(qb, g[2]) + fmul(q[3], g[0]);
+	q[3] += fmul(qa, g[2]) + fmul(qb, g[1]) - fmul(qc, g[0]);
+
+	if (!fusion_normalize(q, 4))
+		fusion_reset(fusion);
+}
+
+/**
+ * fusion_gravity - Updates gravity by an accelerometer sample.
+ * @fusion:	Virtual sensors state
+ * @accel:	Sample of the accelerometer
+ *
+ * Must be called with the state's lock held.
+ * The low-pass filter restarts from the sample after gaps.
+ * Once the gyroscope is read, the direction is taken from the
+ * orientation, which follows rotations without the filter's lag.
+ */
+static void fusion_gravity(struct amd_sfh_fusion *fusion,
+			   const struct sensor_sample *accel)
+{
+	const s64 *q = fusion->quat;
+	s64 *lp = fusion->lowpass;
+	s64 a, dt, alpha, v[3];
+	u64 sum = 0;
+	u32 norm;
+	int i;
+
+	dt = accel->timestamp - fusion->accel_time;
+	alpha = 0;
+	if (fusion->accel_time && dt > 0 && dt <= FUSION_MAX_DT_NS)
+		alpha = div64_s64(dt << FUSION_LP_SHIFT,
+				  FUSION_GRAVITY_TAU_NS + dt);
+
+	fusion->accel_time = accel->timestamp;
+	for (i = 0; i < 3; i++) {
+		a = (s64)accel->values[i] << FUSION_LP_SHIFT;
+		if (alpha)
+			lp[i] += (alpha * (a - lp[i])) >> FUSION_LP_SHIFT;
+		else
+			lp[i] = a;
+
+		v[i] = lp[i] >> FUSION_LP_SHIFT;
+		sum += (u64)(v[i] * v[i]);
+	}
+
+	if (!fusion->gyro_time) {
+		for (i = 0; i < 3; i++)
+			fusion->gravity[i] = v[i];
+
+		return;
+	}
+
+	/* Estimated direction of the reaction to gravity */
+	norm = int_sqrt64(sum);
+	v[0] = 2 * (fmul(q[1], q[3]) - fmul(q[0], q[2]));
+	v[1] = 2 * (fmul(q[0], q[1]) + fmul(q[2], q[3]));
+	v[2] = fmul(q[0], q[0]) - fmul(q[1], q[1]) - fmul(q[2], q[2]) +
+	       fmul(q[3], q[3]);
+
+	for (i = 0; i < 3; i++)
+		fusion->gravity[i] = -fmul(v[i], norm);
+}
+
+/**
+ * fusion_gravity_sample - Returns gravity as sample.
+ * @fusion:	Virtual sensors state
+ * @sample:	Sample to fill
+ *
+ * Must be called with the state's lock held.
+ */
+static void fusion_gravity_sample(const struct amd_sfh_fusion *fusion,
+				  struct sensor_sample *sample)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		sample->values[i] = fusion->gravity[i];
+
+	sample->count = 3;
+}
+
+/**
+ * fusion_linear_sample - Returns the linear acceleration as sample.
+ * @fusion:	Virtual sensors state
+ * @sample:	Sample to fill
+ *
+ * Must be called with the state's lock held.
+ */
+static void fusion_linear_sample(const struct amd_sfh_fusion *fusion,
+				 struct sensor_sample *sample)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		sample->values[i] = fusion->accel[i] - fusion->gravity[i];
+
+	sample->count = 3;
+}
+
+/**
+ * fusion_screen_axis - Determines the screen orientation of a sample.
+ * @a:		Values of an accelerometer sample
+ * @hysteresis:	Degrees by which the sample must pass the diagonals
+ *
+ * The accelerometer points downwards, so the screen is in its normal
+ * orientation if it points along the negative Y axis.
+ * Returns the screen orientation or < zero if the screen lies flat
+ * or the sample is within the hysteresis of a diagonal.
+ */
+static int fusion_screen_axis(const int *a, unsigned int hysteresis)
+{
+	s64 x = a[0], y = a[1], z = a[2];
+	s64 sin, cos;
+	int angle;
+
+	if (FUSION_SCREEN_FLAT_DIV * (x * x + y * y) < x * x + y * y + z * z)
+		return -1;
+
+	angle = 45 - min_t(unsigned int, hysteresis, FUSION_SCREEN_MAX_HYST);
+	sin = fixp_sin32(angle);
+	cos = fixp_cos32(angle);
+
+	if (abs(x) * cos < abs(y) * sin)
+		return y < 0 ? AMD_SFH_SCREEN_NORMAL : AMD_SFH_SCREEN_BOTTOM_UP;
+
+	if (abs(y) * cos < abs(x) * sin)
+		return x > 0 ? AMD_SFH_SCREEN_LEFT_UP : AMD_SFH_SCREEN_RIGHT_UP;
+
+	return -1;
+}
+
+/**
+ * fusion_screen - Updates the screen orientation by an accelerometer sample.
+ * @fusion:	Virtual sensors state
+ * @accel:	Sample of the accelerometer
+ *
+ * Must be called with the state's lock held.
+ * The first orientation is taken without hysteresis and settle time.
+ * Returns true if the screen orientation changed.
+ */
+static bool fusion_screen(struct amd_sfh_fusion *fusion,
+			  const struct sensor_sample *accel)
+{
+	u64 settle = (u64)READ_ONCE(fusion_screen_settle_ms) * NSEC_PER_MSEC;
+	unsigned int hysteresis = 0;
+	int screen;
+
+	if (fusion->has_screen)
+		hysteresis = READ_ONCE(fusion_screen_hysteresis);
+
+	screen = fusion_screen_axis(accel->values, hysteresis);
+	if (screen < 0 || (fusion->has_screen && screen == fusion->screen)) {
+		fusion->screen_time = 0;
+		return false;
+	}
+
+	if (fusion->has_screen) {
+		if (!fusion->screen_time || screen != fusion->screen_next) {
+			fusion->screen_next = screen;
+			fusion->screen_time = accel->timestamp;
+		}
+
+		if (accel->timestamp - fusion->screen_time < settle)
+			return false;
+	}
+
+	fusion->screen = screen;
+	fusion->has_screen = true;
+	fusion->screen_time = 0;
+	return true;
+}
+
+/**
+ * fusion_screen_sample - Returns the screen orientation as sample.
+ * @fusion:	Virtual sensors state
+ * @sample:	Sample to fill
+ *
+ * Must be called with the state's lock held.
+ */
+static void fusion_screen_sample(const struct amd_sfh_fusion *fusion,
+				 struct sensor_sample *sample)
+{
+	sample->values[0] = fusion->screen;
+	sample->count = 1;
+}
+
+/**
+ * fusion_orient_sample - Returns the device orientation as sample.
+ * @fusion:	Virtual sensors state
+ * @sample:	Sample to fill
+ *
+ * Must be called with the state's lock held.
+ * The quaternion is reported in X, Y, Z, W order.
+ */
+static void fusion_orient_sample(const struct amd_sfh_fusion *fusion,
+				 struct sensor_sample *sample)
+{
+	s64 value;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		value = fmul(fusion->quat[(i + 1) % 4], FUSION_QUAT_SCALE);
+		sample->values[i] = fw_value((u32)value);
+	}
+
+	sample->count = 4;
+}
+
+/**
+ * fusion_sensor - Returns the HID device driver data of a sensor.
+ * @privdata:	SFH driver data
+ * @sensor_idx:	Index of the sensor
+ *
+ * Returns NULL if the SFH does not serve the sensor.
+ */
+static struct amd_sfh_hid_data *fusion_sensor(struct amd_sfh_data *privdata,
+					      unsigned int sensor_idx)
+{
+	int i;
+
+	for (i = 0; i < AMD_SFH_MAX_DEVICES; i++) {
+		if (privdata->sensors[i] &&
+		    privdata->sensors[i]->sensor_idx == sensor_idx)
+			return privdata->sensors[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * fusion_sampled - Returns the HID device driver data of a read sensor.
+ * @privdata:	SFH driver data
+ * @sensor_idx:	Index of the sensor
+ *
+ * Returns NULL if the SFH does not serve the sensor or it is not read.
+ */
+static struct amd_sfh_hid_data *fusion_sampled(struct amd_sfh_data *privdata,
+					       unsigned int sensor_idx)
+{
+	struct amd_sfh_hid_data *hid_data = fusion_sensor(privdata, sensor_idx);
+
+	if (!hid_data || !READ_ONCE(hid_data->sampling))
+		return NULL;
+
+	return hid_data;
+}
+
+/**
+ * fusion_put_sources - Releases the sources of a virtual sensor.
+ * @privdata:	SFH driver data
+ * @sources:	Bitmask of the sources to release
+ */
+static void fusion_put_sources(struct amd_sfh_data *privdata,
+			       unsigned long sources)
+{
+	struct amd_sfh_hid_data *source;
+	unsigned int idx;
+
+	for_each_set_bit(idx, &sources, BITS_PER_LONG) {
+		source = fusion_sensor(privdata, idx);
+		if (source)
+			amd_sfh_hid_ll_put(source);
+	}
+}
+
+/**
+ * amd_sfh_fusion_init - Allocates the state of the virtual sensors.
+ * @privdata:	SFH driver data
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_fusion_init(struct amd_sfh_data *privdata)
+{
+	struct amd_sfh_fusion *fusion;
+
+	fusion = devm_kzalloc(&privdata->pci_dev->dev, sizeof(*fusion),
+			      GFP_KERNEL);
+	if (!fusion)
+		return -ENOMEM;
+
+	spin_lock_init(&fusion->lock);
+	fusion_reset(fusion);
+	privdata->fusion = fusion;
+	return 0;
+}
+
+/**
+ * amd_sfh_fusion_open - Starts the sources of a virtual sensor.
+ * @hid_data:	HID device driver data of the virtual sensor
+ *
+ * Optional sources which are missing or fail to start are skipped.
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_fusion_open(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	const struct amd_sfh_sensor_ops *ops = hid_data->ops;
+	unsigned long sources = ops->sources | ops->optional_sources;
+	struct amd_sfh_hid_data *source;
+	unsigned long started = 0;
+	unsigned int idx;
+	int rc = 0;
+
+	for_each_set_bit(idx, &sources, BITS_PER_LONG) {
+		source = fusion_sensor(privdata, idx);
+		rc = source ? amd_sfh_hid_ll_get(source) : -ENODEV;
+		if (!rc)
+			__set_bit(idx, &started);
+		else if (ops->sources & BIT(idx))
+			break;
+		else
+			rc = 0;
+	}
+
+	if (rc) {
+		fusion_put_sources(privdata, started);
+		return rc;
+	}
+
+	hid_data->sources = started;
+	return 0;
+}
+
+/**
+ * amd_sfh_fusion_close - Releases the sources of a virtual sensor.
+ * @hid_data:	HID device driver data of the virtual sensor
+ */
+void amd_sfh_fusion_close(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+
+	fusion_put_sources(privdata, hid_data->sources);
+	hid_data->sources = 0;
+}
+
+/**
+ * amd_sfh_fusion_reset - Discards the computed state of a virtual sensor.
+ * @hid_data:	HID device driver data of the virtual sensor
+ *
+ * The state is shared, so it is kept while other virtual sensors are read,
+ * except for the screen orientation, which is reported on changes only.
+ */
+void amd_sfh_fusion_reset(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_fusion *fusion = privdata->fusion;
+
+	bool shared = fusion_sampled(privdata, ORIENT_IDX) ||
+		      fusion_sampled(privdata, GRAVITY_IDX) ||
+		      fusion_sampled(privdata, LINEAR_ACCEL_IDX) ||
+		      fusion_sampled(privdata, SCREEN_IDX);
+
+	spin_lock(&fusion->lock);
+	if (!shared)
+		fusion_reset(fusion);
+	else if (hid_data->sensor_idx == SCREEN_IDX)
+		fusion_reset_screen(fusion);
+
+	spin_unlock(&fusion->lock);
+}
+
+/**
+ * amd_sfh_fusion_get_sample - Returns the current sample of a virtual sensor.
+ * @hid_data:	HID device driver data of the virtual sensor
+ * @sample:	Sample to fill
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_fusion_get_sample(struct amd_sfh_hid_data *hid_data,
+			      struct sensor_sample *sample)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_fusion *fusion = privdata->fusion;
+	int rc = 0;
+
+	spin_lock(&fusion->lock);
+	switch (hid_data->sensor_idx) {
+	case ORIENT_IDX:
+		fusion_orient_sample(fusion, sample);
+		break;
+	case GRAVITY_IDX:
+		fusion_gravity_sample(fusion, sample);
+		break;
+	case LINEAR_ACCEL_IDX:
+		fusion_linear_sample(fusion, sample);
+		break;
+	case SCREEN_IDX:
+		fusion_screen_sample(fusion, sample);
+		break;
+	default:
+		rc = -EINVAL;
+		break;
+	}
+
+	spin_unlock(&fusion->lock);
+	return rc;
+}
+
+/**
+ * amd_sfh_fusion_push - Updates the virtual sensors with a sample.
+ * @hid_data:	HID device driver data of the physical sensor
+ * @sample:	Sample of the physical sensor
+ * @due:	Time at which the report of the sample was due
+ *
+ * The device orientation is advanced by every gyroscope sample,
+ * using the latest accelerometer and magnetometer samples.
+ * Gravity, the linear acceleration and the screen orientation are
+ * updated by every accelerometer sample, the former two using the
+ * latest orientation. The screen orientation is pushed on changes only.
+ * Nothing is computed unless a virtual sensor is read.
+ */
+void amd_sfh_fusion_push(struct amd_sfh_hid_data *hid_data,
+			 const struct sensor_sample *sample, ktime_t due)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_fusion *fusion = privdata->fusion;
+	struct amd_sfh_hid_data *orient, *gravity, *linear, *screen;
+	struct amd_sfh_hid_data *targets[4] = { NULL };
+	struct sensor_sample out[4];
+	int i;
+
+	if (!fusion || !READ_ONCE(hid_data->users))
+		return;
+
+	orient = fusion_sampled(privdata, ORIENT_IDX);
+	gravity = fusion_sampled(privdata, GRAVITY_IDX);
+	linear = fusion_sampled(privdata, LINEAR_ACCEL_IDX);
+	screen = fusion_sampled(privdata, SCREEN_IDX);
+	if (!orient && !gravity && !linear && !screen)
+		return;
+
+	spin_lock(&fusion->lock);
+	switch (hid_data->sensor_idx) {
+	case ACCEL_IDX:
+		memcpy(fusion->accel, sample->values, sizeof(fusion->accel));
+		fusion->has_accel = true;
+		if (gravity || linear) {
+			fusion_gravity(fusion, sample);
+			fusion_gravity_sample(fusion, &out[1]);
+			fusion_linear_sample(fusion, &out[2]);
+			targets[1] = gravity;
+			targets[2] = linear;
+		}
+
+		if (screen && fusion_screen(fusion, sample)) {
+			fusion_screen_sample(fusion, &out[3]);
+			targets[3] = screen;
+		}
+
+		break;
+	case MAG_IDX:
+		memcpy(fusion->mag, sample->values, sizeof(fusion->mag));
+		fusion->has_mag = true;
+		break;
+	case GYRO_IDX:
+		fusion_update(fusion, sample);
+		fusion_orient_sample(fusion, &out[0]);
+		targets[0] = orient;
+		break;
+	default:
+		break;
+	}
+
+	spin_unlock(&fusion->lock);
+	for (i = 0; i < ARRAY_SIZE(targets); i++) {
+		if (!targets[i])
+			continue;
+
+		out[i].timestamp = sample->timestamp;
+		amd_sfh_hid_ll_push(targets[i], &out[i], due);
+	}
+}
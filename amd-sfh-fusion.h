@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub virtual sensors interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_FUSION_H
+#define AMD_SFH_FUSION_H
+
+#include <linux/ktime.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "sensors/amd-sfh-sensors.h"
+
+/**
+ * enum amd_sfh_screen - Screen orientations by the edge pointing upwards.
+ * @AMD_SFH_SCREEN_NORMAL:	The top edge
+ * @AMD_SFH_SCREEN_LEFT_UP:	The left edge
+ * @AMD_SFH_SCREEN_RIGHT_UP:	The right edge
+ * @AMD_SFH_SCREEN_BOTTOM_UP:	The bottom edge
+ */
+enum amd_sfh_screen {
+	AMD_SFH_SCREEN_NORMAL = 0,
+	AMD_SFH_SCREEN_LEFT_UP,
+	AMD_SFH_SCREEN_RIGHT_UP,
+	AMD_SFH_SCREEN_BOTTOM_UP,
+};
+
+int amd_sfh_fusion_init(struct amd_sfh_data *privdata);
+int amd_sfh_fusion_open(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_fusion_close(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_fusion_reset(struct amd_sfh_hid_data *hid_data);
+int amd_sfh_fusion_get_sample(struct amd_sfh_hid_data *hid_data,
+			      struct sensor_sample *sample);
+void amd_sfh_fusion_push(struct amd_sfh_hid_data *hid_data,
+			 const struct sensor_sample *sample, ktime_t due);
+
+#endif
@@ -8,38 +8,529 @@
  *		Richard Neumann <mail@richard-neumann.de>
  */
 
+#include <linux/bitops.h>
 #include <linux/dma-mapping.h>
 #include <linux/hid.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/pci.h>
+#include <linux/pm_runtime.h>
 #include <linux/sched.h>
-#include <linux/workqueue.h>
+#include <linux/slab.h>
+#include <linux/timekeeping.h>
 
 #include "amd-sfh.h"
+#include "amd-sfh-cdev.h"
+#include "amd-sfh-debugfs.h"
+#include "amd-sfh-fusion.h"
 #include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-iio.h"
+#include "amd-sfh-input.h"
 #include "amd-sfh-pci.h"
+#include "amd-sfh-sched.h"
+#include "amd-sfh-trace.h"
 #include "sensors/amd-sfh-sensors.h"
 
-#define AMD_SFH_HID_DMA_SIZE	(sizeof(int) * 8)
+#define HID_USAGE_PAGE_SENSOR	0x20
+
+/* Prefixes of short report descriptor items without their size */
+#define AMD_SFH_ITEM_USAGE_PAGE		0x04
+#define AMD_SFH_ITEM_USAGE		0x08
+#define AMD_SFH_ITEM_UNIT_EXPONENT	0x54
+#define AMD_SFH_ITEM_LONG		0xFE
+
+bool amd_sfh_high_precision;
+module_param_named(high_precision, amd_sfh_high_precision, bool, 0444);
+MODULE_PARM_DESC(high_precision, "report values with full firmware precision");
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_high_precision);
+
+/**
+ * hid_ll_irq - Returns the SFH interrupt line.
+ * @hid_data:	HID device driver data
+ *
+ * Returns the interrupt line delivering new data
+ * or zero if the sensor must be polled.
+ */
+static int hid_ll_irq(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+
+	return privdata->irq;
+}
+
+/**
+ * hid_ll_sync - Waits for a running delivery of samples to complete.
+ * @hid_data:	HID device driver data
+ */
+static void hid_ll_sync(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	int irq = hid_ll_irq(hid_data);
+
+	if (irq)
+		synchronize_irq(irq);
+	else
+		amd_sfh_sched_sync(privdata);
+}
+
+/**
+ * amd_sfh_hid_ll_get_sample - Reads the current sample of a sensor.
+ * @hid_data:	HID device driver data
+ * @sample:	Sample to fill
+ *
+ * Stamps the sample with the time it is read from the DRAM.
+ * Virtual sensors return their last computed sample.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_hid_ll_get_sample(struct amd_sfh_hid_data *hid_data,
+			      struct sensor_sample *sample)
+{
+	sample->timestamp = ktime_get_boottime_ns();
+	if (!hid_data->ops->get_sample)
+		return amd_sfh_fusion_get_sample(hid_data, sample);
+
+	return hid_data->ops->get_sample(hid_data->cpu_addr, hid_data->pci_dev,
+					 hid_data->version, sample);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_get_sample);
+
+/**
+ * hid_ll_sample_changed - Checks whether a sample exceeds the sensitivity.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ *
+ * Returns true if any value of the sample differs from the last
+ * reported sample by more than the respective axis' sensitivity.
+ */
+static bool hid_ll_sample_changed(struct amd_sfh_hid_data *hid_data,
+				  const struct sensor_sample *sample)
+{
+	struct sensor_sample *last = &hid_data->last_sample;
+	int i;
+
+	if (sample->count != last->count)
+		return true;
+
+	for (i = 0; i < sample->count; i++) {
+		if (abs((s64)sample->values[i] - last->values[i]) >
+		    READ_ONCE(hid_data->settings.sensitivity[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * hid_ll_sample_equal - Checks whether a sample equals the last sample.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ */
+static bool hid_ll_sample_equal(struct amd_sfh_hid_data *hid_data,
+				const struct sensor_sample *sample)
+{
+	struct sensor_sample *last = &hid_data->last_sample;
+
+	return sample->count == last->count &&
+	       !memcmp(sample->values, last->values,
+		       sample->count * sizeof(*sample->values));
+}
+
+/**
+ * hid_ll_deliver - Pushes a sample to its consumer.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ *
+ * Formats the input report into the preallocated
+ * report buffer and passes it to hid_input_report().
+ * Sensors served by the IIO or input backend receive the sample as is.
+ */
+static void hid_ll_deliver(struct amd_sfh_hid_data *hid_data,
+			   const struct sensor_sample *sample)
+{
+	int len;
+
+	if (hid_data->indio_dev) {
+		amd_sfh_iio_push(hid_data, sample);
+		hid_data->stats.samples++;
+		return;
+	}
+
+	if (hid_data->input) {
+		amd_sfh_input_push(hid_data, sample);
+		hid_data->stats.samples++;
+		return;
+	}
+
+	len = hid_data->ops->get_input_report(AMD_SFH_INPUT_REPORT_ID,
+					      hid_data->report_buf,
+					      sizeof(hid_data->report_buf),
+					      sample);
+	trace_amd_sfh_input_report(hid_data->sensor_idx, len, sample);
+	if (len <= 0)
+		return;
+
+	hid_input_report(hid_data->hid, HID_INPUT_REPORT, hid_data->report_buf,
+			 len, 1);
+	hid_data->stats.samples++;
+}
+
+/**
+ * hid_ll_batch_due - Checks whether the batched samples must be delivered.
+ * @hid_data:	HID device driver data
+ *
+ * Returns true if the FIFO is full or if its oldest sample
+ * has been held back for at least the maximum report latency.
+ */
+static bool hid_ll_batch_due(struct amd_sfh_hid_data *hid_data)
+{
+	u32 latency = READ_ONCE(hid_data->settings.report_latency);
+	struct sensor_sample oldest;
+
+	if (!kfifo_peek(&hid_data->fifo, &oldest))
+		return false;
+
+	if (!latency || kfifo_is_full(&hid_data->fifo))
+		return true;
+
+	return ktime_get_boottime_ns() - oldest.timestamp >=
+	       (u64)latency * NSEC_PER_MSEC;
+}
+
+/**
+ * hid_ll_flush - Delivers all batched samples.
+ * @hid_data:	HID device driver data
+ */
+static void hid_ll_flush(struct amd_sfh_hid_data *hid_data)
+{
+	struct sensor_sample sample;
+
+	while (kfifo_get(&hid_data->fifo, &sample))
+		hid_ll_deliver(hid_data, &sample);
+}
+
+/**
+ * hid_ll_batch_arm - Schedules the draining of the batched samples.
+ * @hid_data:	HID device driver data
+ *
+ * Queues the batch work on the scheduler's worker for the time at which
+ * the oldest sample reaches the maximum report latency, so that batched
+ * samples are delivered even if no further sample arrives.
+ * A pending batch work is left untouched, since it re-arms itself.
+ */
+static void hid_ll_batch_arm(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	u32 latency = READ_ONCE(hid_data->settings.report_latency);
+	struct sensor_sample oldest;
+	u64 expires, now;
+
+	if (!kfifo_peek(&hid_data->fifo, &oldest))
+		return;
+
+	expires = oldest.timestamp + (u64)latency * NSEC_PER_MSEC;
+	now = ktime_get_boottime_ns();
+	kthread_queue_delayed_work(privdata->sched_worker,
+				   &hid_data->batch_work,
+				   expires > now ?
+				   nsecs_to_jiffies(expires - now) + 1 : 0);
+}
 
 /**
- * hid_ll_poll - Updates the input report for a HID device.
- * @work:	Delayed work
+ * hid_ll_batch_expired - Drains the batched samples of a sensor.
+ * @work:	Kthread work
  *
- * Polls input reports from the respective HID devices and submits
- * them by invoking hid_hw_request() from hid.h.
+ * Delivers the batched samples once the oldest one reached the maximum
+ * report latency or re-arms itself if the latency has been raised since.
  */
-static void hid_ll_poll(struct work_struct *work)
+static void hid_ll_batch_expired(struct kthread_work *work)
 {
 	struct amd_sfh_hid_data *hid_data;
-	struct hid_report *report;
 
-	hid_data = container_of(work, struct amd_sfh_hid_data, work.work);
+	hid_data = container_of(work, struct amd_sfh_hid_data,
+				batch_work.work);
+	mutex_lock(&hid_data->fifo_lock);
+	if (READ_ONCE(hid_data->sampling) && READ_ONCE(hid_data->opens)) {
+		if (hid_ll_batch_due(hid_data))
+			hid_ll_flush(hid_data);
+		else
+			hid_ll_batch_arm(hid_data);
+	}
+
+	mutex_unlock(&hid_data->fifo_lock);
+}
+
+/**
+ * hid_ll_batch_cancel - Stops the draining of the batched samples.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called once no more samples are submitted to the sensor's
+ * own device. Samples left in the FIFO are discarded on the next open.
+ */
+static void hid_ll_batch_cancel(struct amd_sfh_hid_data *hid_data)
+{
+	kthread_cancel_delayed_work_sync(&hid_data->batch_work);
+}
+
+/**
+ * hid_ll_submit - Submits a sample to the FIFO of an open sensor.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ * @start:	Time at which the processing of the sample started
+ * @due:	Time at which the report was due
+ *
+ * The FIFO is drained to the HID core in one batch once the oldest
+ * sample reaches the maximum report latency, which defaults to zero,
+ * i.e. to delivering every sample immediately. The batch work drains
+ * it on time if no further sample arrives until then.
+ * In the threshold events reporting state, samples that do not
+ * exceed the change sensitivity are suppressed.
+ */
+static void hid_ll_submit(struct amd_sfh_hid_data *hid_data,
+			  const struct sensor_sample *sample, ktime_t start,
+			  ktime_t due)
+{
+	struct amd_sfh_stats *stats = &hid_data->stats;
+	bool batching;
+
+	mutex_lock(&hid_data->fifo_lock);
+
+	if (hid_ll_sample_equal(hid_data, sample))
+		stats->duplicates++;
+
+	if (threshold_events(&hid_data->settings) &&
+	    !hid_ll_sample_changed(hid_data, sample))
+		goto drain;
+
+	hid_data->last_sample = *sample;
+	amd_sfh_hist_add(stats->latency, ktime_sub(start, due));
+	if (stats->last_delivery)
+		amd_sfh_hist_add(stats->interval,
+				 ktime_sub(start, stats->last_delivery));
 
-	report = hid_register_report(hid_data->hid, HID_INPUT_REPORT, 1, 1);
-	if (report)
-		hid_hw_request(hid_data->hid, report, HID_REQ_GET_REPORT);
+	stats->last_delivery = start;
+	if (kfifo_is_full(&hid_data->fifo))
+		hid_ll_flush(hid_data);
 
-	schedule_delayed_work(&hid_data->work, AMD_SFH_UPDATE_INTERVAL);
+	batching = kfifo_is_empty(&hid_data->fifo);
+	kfifo_put(&hid_data->fifo, *sample);
+drain:
+	if (hid_ll_batch_due(hid_data))
+		hid_ll_flush(hid_data);
+	else if (batching)
+		hid_ll_batch_arm(hid_data);
+
+	mutex_unlock(&hid_data->fifo_lock);
+}
+
+/**
+ * amd_sfh_hid_ll_report - Submits the current sample of a sensor.
+ * @hid_data:	HID device driver data
+ * @due:	Time at which the report was due
+ *
+ * Reads the current sample of a sampled sensor and passes it to the
+ * sample ring, the virtual sensors, the input devices and, if the
+ * sensor's own device is open, to its FIFO.
+ */
+void amd_sfh_hid_ll_report(struct amd_sfh_hid_data *hid_data, ktime_t due)
+{
+	struct amd_sfh_stats *stats = &hid_data->stats;
+	struct sensor_sample sample;
+	ktime_t start = ktime_get();
+
+	if (!READ_ONCE(hid_data->sampling))
+		return;
+
+	if (amd_sfh_hid_ll_get_sample(hid_data, &sample)) {
+		stats->errors++;
+		goto out;
+	}
+
+	if (stats->resume_time) {
+		stats->resume_ns = ktime_to_ns(ktime_sub(start,
+							 stats->resume_time));
+		stats->resume_time = 0;
+	}
+
+	/* The firmware signalled the new data at the time of the interrupt */
+	if (hid_ll_irq(hid_data))
+		sample.timestamp = ktime_to_ns(ktime_mono_to_any(due,
+								 TK_OFFS_BOOT));
+
+	amd_sfh_cdev_push(hid_data, &sample);
+	amd_sfh_fusion_push(hid_data, &sample, due);
+	amd_sfh_input_update(hid_data, &sample);
+	if (READ_ONCE(hid_data->opens))
+		hid_ll_submit(hid_data, &sample, start, due);
+out:
+	stats->poll_elapsed_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/**
+ * amd_sfh_hid_ll_push - Submits a sample computed for a virtual sensor.
+ * @hid_data:	HID device driver data of the virtual sensor
+ * @sample:	Computed sample
+ * @due:	Time at which the report of the source sensor was due
+ */
+void amd_sfh_hid_ll_push(struct amd_sfh_hid_data *hid_data,
+			 const struct sensor_sample *sample, ktime_t due)
+{
+	ktime_t start = ktime_get();
+
+	if (!READ_ONCE(hid_data->sampling) || !READ_ONCE(hid_data->opens))
+		return;
+
+	amd_sfh_cdev_push(hid_data, sample);
+	hid_ll_submit(hid_data, sample, start, due);
+	hid_data->stats.poll_elapsed_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/**
+ * hid_ll_update_feature_report - Rebuilds the feature report of a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called with the HID device driver data's lock held
+ * whenever the sensor settings change, so that requests for the
+ * feature report only need to copy it.
+ */
+static void hid_ll_update_feature_report(struct amd_sfh_hid_data *hid_data)
+{
+	hid_data->feature_len = hid_data->ops->get_feature_report(
+		AMD_SFH_FEATURE_REPORT_ID, hid_data->feature_report,
+		sizeof(hid_data->feature_report), &hid_data->settings);
+}
+
+/**
+ * hid_ll_get_feature_report - Copies the feature report of a sensor.
+ * @hid_data:	HID device driver data
+ * @reportnum:	HID report ID
+ * @buf:	Report buffer
+ * @len:	Size of the report buffer
+ *
+ * Returns the amount of bytes written on success or < zero on errors.
+ */
+static int hid_ll_get_feature_report(struct amd_sfh_hid_data *hid_data,
+				     int reportnum, u8 *buf, size_t len)
+{
+	int rc;
+
+	mutex_lock(&hid_data->lock);
+	rc = min_t(int, len, hid_data->feature_len);
+	if (rc > 0) {
+		memcpy(buf, hid_data->feature_report, rc);
+		buf[0] = reportnum;
+	}
+
+	mutex_unlock(&hid_data->lock);
+	return rc;
+}
+
+/*
+ * Sensor page usages of the values multiplied by AMD_SFH_FW_MUL and of
+ * their absolute change sensitivity, which is compared to these values.
+ * Their maximum and minimum are constants and are not scaled.
+ */
+static const u16 hid_ll_scaled_usages[] = {
+	0x0453, 0x0454, 0x0455,		/* Acceleration X, Y, Z */
+	0x0457, 0x0458, 0x0459,		/* Angular velocity X, Y, Z */
+	0x0483,				/* Orientation quaternion */
+	0x0485, 0x0486, 0x0487,		/* Magnetic flux X, Y, Z */
+	0x04D1,				/* Illuminance */
+	0x1452, 0x1456, 0x1483, 0x1484,	/* Change sensitivity ABS */
+};
+
+/**
+ * hid_ll_scaled_usage - Checks whether a usage holds scaled sensor values.
+ * @page:	Usage page
+ * @usage:	Usage ID including its modifier
+ *
+ * Returns true for the fields holding values written by the firmware,
+ * which are reported as is in high precision mode.
+ */
+static bool hid_ll_scaled_usage(u32 page, u32 usage)
+{
+	int i;
+
+	if (page != HID_USAGE_PAGE_SENSOR)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(hid_ll_scaled_usages); i++) {
+		if (usage == hid_ll_scaled_usages[i])
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * hid_ll_lower_exponent - Lowers a unit exponent by that of AMD_SFH_FW_MUL.
+ * @data:	Data of a one byte unit exponent item
+ *
+ * Accepts both the nibble and the byte encoded exponent.
+ * Returns the lowered exponent in the nibble encoding if possible.
+ */
+static u8 hid_ll_lower_exponent(u8 data)
+{
+	int exp = data & 0xF0 ? (s8)data : sign_extend32(data, 3);
+
+	exp -= AMD_SFH_FW_MUL_EXP;
+	return exp >= -8 ? exp & 0x0F : (u8)exp;
+}
+
+/**
+ * hid_ll_scale_descriptor - Adjusts a report descriptor for high precision.
+ * @desc:	Copy of the report descriptor to adjust
+ * @size:	Size of the report descriptor
+ *
+ * Lowers the unit exponents of the scaled sensor values, so that they
+ * match the values as written by the firmware. Since the unit exponent
+ * is a global item, fields following a scaled one must set their own.
+ */
+static void hid_ll_scale_descriptor(u8 *desc, unsigned int size)
+{
+	unsigned int i, len;
+	u32 page = 0, usage = 0;
+	u8 item;
+
+	for (i = 0; i < size; i += 1 + len) {
+		item = desc[i];
+		if (item == AMD_SFH_ITEM_LONG) {
+			len = i + 1 < size ? 2 + desc[i + 1] : 0;
+			continue;
+		}
+
+		len = item & 0x03;
+		if (len == 3)
+			len = 4;
+
+		if (i + len >= size)
+			return;
+
+		switch (item & 0xFC) {
+		case AMD_SFH_ITEM_USAGE_PAGE:
+			page = len ? desc[i + 1] : 0;
+			if (len > 1)
+				page |= desc[i + 2] << 8;
+			break;
+		case AMD_SFH_ITEM_USAGE:
+			usage = len ? desc[i + 1] : 0;
+			if (len > 1)
+				usage |= desc[i + 2] << 8;
+			break;
+		case AMD_SFH_ITEM_UNIT_EXPONENT:
+			if (len == 1 && hid_ll_scaled_usage(page, usage))
+				desc[i + 1] = hid_ll_lower_exponent(desc[i + 1]);
+			break;
+		default:
+			if (((item >> 2) & 0x03) == HID_ITEM_TYPE_MAIN)
+				usage = 0;
+			break;
+		}
+	}
 }
 
 /**
@@ -53,155 +544,600 @@ static void hid_ll_poll(struct work_struct *work)
 static int hid_ll_parse(struct hid_device *hid)
 {
 	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	const struct amd_sfh_sensor_ops *ops = hid_data->ops;
+	u8 *desc;
+	int rc;
 
-	switch (hid_data->sensor_idx) {
-	case ACCEL_IDX:
-		return parse_accel_descriptor(hid);
-	case ALS_IDX:
-		return parse_als_descriptor(hid);
-	case GYRO_IDX:
-		return parse_gyro_descriptor(hid);
-	case LID_IDX:
-		return parse_lid_descriptor(hid);
-	case MAG_IDX:
-		return parse_mag_descriptor(hid);
-	default:
+	if (!amd_sfh_high_precision)
+		return hid_parse_report(hid, ops->descriptor,
+					ops->descriptor_size);
+
+	desc = kmemdup(ops->descriptor, ops->descriptor_size, GFP_KERNEL);
+	if (!desc)
+		return -ENOMEM;
+
+	hid_ll_scale_descriptor(desc, ops->descriptor_size);
+	rc = hid_parse_report(hid, desc, ops->descriptor_size);
+	kfree(desc);
+	return rc;
+}
+
+/**
+ * change_sensitivity_show - Shows the per-axis change sensitivity.
+ * @dev:	HID device's device
+ * @attr:	Device attribute
+ * @buf:	Output buffer
+ */
+static ssize_t change_sensitivity_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	struct amd_sfh_hid_data *hid_data = to_hid_device(dev)->driver_data;
+	u16 *sensitivity = hid_data->settings.sensitivity;
+
+	BUILD_BUG_ON(AMD_SFH_MAX_AXES != 4);
+	return sprintf(buf, "%u %u %u %u\n", sensitivity[0], sensitivity[1],
+		       sensitivity[2], sensitivity[3]);
+}
+
+/**
+ * change_sensitivity_store - Sets the per-axis change sensitivity.
+ * @dev:	HID device's device
+ * @attr:	Device attribute
+ * @buf:	Input buffer
+ * @count:	Size of the input buffer
+ *
+ * Accepts up to one value per axis, separated by spaces.
+ * Axes without a value retain their sensitivity.
+ */
+static ssize_t change_sensitivity_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct amd_sfh_hid_data *hid_data = to_hid_device(dev)->driver_data;
+	u16 sensitivity[AMD_SFH_MAX_AXES];
+	int n;
+
+	n = sscanf(buf, "%hu %hu %hu %hu", &sensitivity[0], &sensitivity[1],
+		   &sensitivity[2], &sensitivity[3]);
+	if (n < 1)
 		return -EINVAL;
-	}
+
+	mutex_lock(&hid_data->lock);
+	memcpy(hid_data->settings.sensitivity, sensitivity,
+	       n * sizeof(*sensitivity));
+	hid_ll_update_feature_report(hid_data);
+	mutex_unlock(&hid_data->lock);
+	return count;
 }
 
+static DEVICE_ATTR_RW(change_sensitivity);
+
+/**
+ * amd_sfh_hid_ll_init - Sets up the device of a HID device driver data.
+ * @hid_data:	HID device driver data
+ *
+ * Called whenever a HID, IIO or input device is bound to the sensor.
+ * The sensor's slots of the SFH's DMA memory are owned by the client,
+ * since the sensor may keep being sampled for other users.
+ */
+void amd_sfh_hid_ll_init(struct amd_sfh_hid_data *hid_data)
+{
+	kthread_init_delayed_work(&hid_data->batch_work, hid_ll_batch_expired);
+	mutex_lock(&hid_data->lock);
+	hid_ll_update_feature_report(hid_data);
+	mutex_unlock(&hid_data->lock);
+	amd_sfh_debugfs_add(hid_data);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_init);
+
+/**
+ * amd_sfh_hid_ll_deinit - Tears down the device of a HID device driver data.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_hid_ll_deinit(struct amd_sfh_hid_data *hid_data)
+{
+	amd_sfh_debugfs_remove(hid_data);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_deinit);
+
 /**
  * hid_ll_start - Starts the HID device.
  * @hid:	HID device
  *
- * Allocates DMA memory on the PCI device.
  * Returns 0 on success and non-zero on errors.
  */
 static int hid_ll_start(struct hid_device *hid)
 {
 	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	int rc;
 
-	hid_data->cpu_addr = dma_alloc_coherent(&hid_data->pci_dev->dev,
-						AMD_SFH_HID_DMA_SIZE,
-						&hid_data->dma_handle,
-						GFP_KERNEL);
-	if (!hid_data->cpu_addr)
-		return -EIO;
+	amd_sfh_hid_ll_init(hid_data);
+	rc = device_create_file(&hid->dev, &dev_attr_change_sensitivity);
+	if (rc)
+		amd_sfh_hid_ll_deinit(hid_data);
 
-	INIT_DELAYED_WORK(&hid_data->work, hid_ll_poll);
-	return 0;
+	return rc;
 }
 
 /**
  * hid_ll_stop - Stops the HID device.
  * @hid:	HID device
- *
- * Frees the DMA memory on the PCI device.
  */
 static void hid_ll_stop(struct hid_device *hid)
 {
-	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	device_remove_file(&hid->dev, &dev_attr_change_sensitivity);
+	amd_sfh_hid_ll_deinit(hid->driver_data);
+}
+
+/**
+ * hid_ll_reset_delivery - Discards the state of previous deliveries.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called with the HID device driver data's lock held
+ * while no samples are delivered to the sensor's own device.
+ */
+static void hid_ll_reset_delivery(struct amd_sfh_hid_data *hid_data)
+{
+	memset(&hid_data->last_sample, 0, sizeof(hid_data->last_sample));
+	kfifo_reset(&hid_data->fifo);
+	hid_data->stats.last_delivery = 0;
+}
+
+/**
+ * hid_ll_start_sampling - Starts a sensor and the reading of its samples.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called with the HID device driver data's lock held.
+ * Virtual sensors are not started on the SFH, but are computed
+ * from the samples of their sources from now on.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int hid_ll_start_sampling(struct amd_sfh_hid_data *hid_data)
+{
+	int rc;
+
+	hid_ll_reset_delivery(hid_data);
+	if (hid_data->ops->sources) {
+		amd_sfh_fusion_reset(hid_data);
+		WRITE_ONCE(hid_data->sampling, true);
+		return 0;
+	}
+
+	/* The sensor's device failed to register */
+	if (!hid_data->cpu_addr)
+		return -ENODEV;
+
+	rc = amd_sfh_start_sensor(hid_data->pci_dev, hid_data->sensor_idx,
+				  hid_data->dma_handle,
+				  hid_data->settings.report_interval);
+	if (rc)
+		return rc;
+
+	WRITE_ONCE(hid_data->sampling, true);
+	if (!hid_ll_irq(hid_data))
+		amd_sfh_sched_add(hid_data);
+
+	return 0;
+}
+
+/**
+ * hid_ll_stop_delivery - Stops the reading of a sensor's samples.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called with the HID device driver data's lock held.
+ * Waits for a running delivery to complete, but leaves
+ * the sensor itself running.
+ */
+static void hid_ll_stop_delivery(struct amd_sfh_hid_data *hid_data)
+{
+	WRITE_ONCE(hid_data->sampling, false);
+	if (hid_data->ops->sources || hid_ll_irq(hid_data))
+		hid_ll_sync(hid_data);
+	else
+		amd_sfh_sched_remove(hid_data);
+
+	hid_ll_batch_cancel(hid_data);
+}
+
+/**
+ * hid_ll_get - Adds a user to a sensor.
+ * @hid_data:	HID device driver data
+ * @own:	Whether the user is the sensor's own device
+ *
+ * Resumes the SFH and starts the sensor for its first user, or for any
+ * user if it failed to restart after system sleep.
+ * Samples are delivered to the sensor's own device only while it is open.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int hid_ll_get(struct amd_sfh_hid_data *hid_data, bool own)
+{
+	struct device *dev = &hid_data->pci_dev->dev;
+	int rc;
+
+	rc = pm_runtime_get_sync(dev);
+	if (rc < 0) {
+		pm_runtime_put_noidle(dev);
+		return rc;
+	}
+
+	rc = 0;
+	mutex_lock(&hid_data->lock);
+	if (!hid_data->sampling) {
+		rc = hid_ll_start_sampling(hid_data);
+		if (!rc)
+			hid_data->suspended = false;
+	} else if (own && !hid_data->opens) {
+		hid_ll_reset_delivery(hid_data);
+	}
+
+	if (!rc && own)
+		WRITE_ONCE(hid_data->opens, hid_data->opens + 1);
+	else if (!rc)
+		hid_data->users++;
+
+	mutex_unlock(&hid_data->lock);
+	if (rc)
+		pm_runtime_put_autosuspend(dev);
+
+	return rc;
+}
+
+/**
+ * hid_ll_put - Removes a user from a sensor.
+ * @hid_data:	HID device driver data
+ * @own:	Whether the user is the sensor's own device
+ *
+ * Stops the sensor once its last user is gone and
+ * lets the SFH autosuspend once the last sensor is stopped.
+ */
+static void hid_ll_put(struct amd_sfh_hid_data *hid_data, bool own)
+{
+	struct device *dev = &hid_data->pci_dev->dev;
+
+	mutex_lock(&hid_data->lock);
+	if (own)
+		WRITE_ONCE(hid_data->opens, hid_data->opens - 1);
+	else
+		hid_data->users--;
+
+	if (!hid_data->opens && !hid_data->users) {
+		if (hid_data->sampling) {
+			hid_ll_stop_delivery(hid_data);
+			if (!hid_data->ops->sources)
+				amd_sfh_stop_sensor(hid_data->pci_dev,
+						    hid_data->sensor_idx);
+		}
+
+		hid_data->suspended = false;
+	} else if (own && !hid_data->opens && hid_data->sampling) {
+		/* Virtual sensors still use the sensor, but it is closed */
+		hid_ll_sync(hid_data);
+		hid_ll_batch_cancel(hid_data);
+	}
+
+	mutex_unlock(&hid_data->lock);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
 
-	dma_free_coherent(&hid_data->pci_dev->dev, AMD_SFH_HID_DMA_SIZE,
-			  hid_data->cpu_addr, hid_data->dma_handle);
-	hid_data->cpu_addr = NULL;
+/**
+ * amd_sfh_hid_ll_open - Starts delivering samples of a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Resumes the SFH, starts the corresponding sensor via the PCI
+ * driver and schedules report polling unless reports are
+ * delivered by interrupts.
+ * Virtual sensors start the sensors they are computed from instead.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_hid_ll_open(struct amd_sfh_hid_data *hid_data)
+{
+	int rc;
+
+	trace_amd_sfh_open(hid_data->sensor_idx,
+			   hid_data->settings.report_interval);
+	if (!hid_data->ops->sources)
+		return hid_ll_get(hid_data, true);
+
+	rc = amd_sfh_fusion_open(hid_data);
+	if (rc)
+		return rc;
+
+	rc = hid_ll_get(hid_data, true);
+	if (rc)
+		amd_sfh_fusion_close(hid_data);
+
+	return rc;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_open);
+
+/**
+ * amd_sfh_hid_ll_close - Stops delivering samples of a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Stops report polling and the corresponding sensor via the PCI driver,
+ * unless virtual sensors still use it.
+ */
+void amd_sfh_hid_ll_close(struct amd_sfh_hid_data *hid_data)
+{
+	trace_amd_sfh_close(hid_data->sensor_idx,
+			    hid_data->settings.report_interval);
+	hid_ll_put(hid_data, true);
+	if (hid_data->ops->sources)
+		amd_sfh_fusion_close(hid_data);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_close);
+
+/**
+ * amd_sfh_hid_ll_get - Keeps a sensor sampled for a virtual sensor.
+ * @hid_data:	HID device driver data of the source sensor
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_hid_ll_get(struct amd_sfh_hid_data *hid_data)
+{
+	return hid_ll_get(hid_data, false);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_get);
+
+/**
+ * amd_sfh_hid_ll_put - Releases a sensor sampled for a virtual sensor.
+ * @hid_data:	HID device driver data of the source sensor
+ */
+void amd_sfh_hid_ll_put(struct amd_sfh_hid_data *hid_data)
+{
+	hid_ll_put(hid_data, false);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_hid_ll_put);
+
+/**
+ * amd_sfh_hid_ll_suspend - Prepares a sensor for system sleep.
+ * @hid_data:	HID device driver data
+ *
+ * Stops the delivery of samples of a sampled sensor and remembers
+ * to restart it on resume. The PCI driver stops the sensors themselves.
+ */
+void amd_sfh_hid_ll_suspend(struct amd_sfh_hid_data *hid_data)
+{
+	mutex_lock(&hid_data->lock);
+	if (hid_data->sampling) {
+		hid_ll_stop_delivery(hid_data);
+		hid_data->suspended = true;
+	}
+
+	mutex_unlock(&hid_data->lock);
+}
+
+/**
+ * amd_sfh_hid_ll_resume - Restores a sensor after system sleep.
+ * @hid_data:	HID device driver data
+ *
+ * Restarts a sensor that was sampled on suspend with its report interval.
+ * A sensor that fails to restart stays marked as suspended, so that it is
+ * restarted by the next open or by the next resume.
+ */
+void amd_sfh_hid_ll_resume(struct amd_sfh_hid_data *hid_data)
+{
+	int rc;
+
+	mutex_lock(&hid_data->lock);
+	if (!hid_data->suspended || hid_data->sampling)
+		goto out;
+
+	hid_data->stats.resume_time = ktime_get();
+	rc = hid_ll_start_sampling(hid_data);
+	if (rc) {
+		hid_data->stats.resume_time = 0;
+		pci_warn(hid_data->pci_dev,
+			 "Failed to restart sensor %d on resume: %d\n",
+			 hid_data->sensor_idx, rc);
+		goto out;
+	}
+
+	hid_data->suspended = false;
+out:
+	mutex_unlock(&hid_data->lock);
 }
 
 /**
  * hid_ll_open - Opens the HID device.
  * @hid:	HID device
  *
- * Starts the corresponding sensor via the PCI driver
- * and schedules report polling.
- *
- * Return 0 on success and 1 on errors.
+ * Return 0 on success.
  */
 static int hid_ll_open(struct hid_device *hid)
 {
-	struct amd_sfh_hid_data *hid_data = hid->driver_data;
-
-	amd_sfh_start_sensor(hid_data->pci_dev, hid_data->sensor_idx,
-			     hid_data->dma_handle);
-	return !schedule_delayed_work(&hid_data->work, AMD_SFH_UPDATE_INTERVAL);
+	return amd_sfh_hid_ll_open(hid->driver_data);
 }
 
 /**
  * hid_ll_close - Closes the HID device.
  * @hid:	HID device
- *
- * Stops report polling and the corresponding sensor via the PCI driver.
  */
 static void hid_ll_close(struct hid_device *hid)
 {
-	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	amd_sfh_hid_ll_close(hid->driver_data);
+}
+
+/**
+ * hid_ll_set_interval - Changes the report interval of a HID device.
+ * @hid_data:	HID device driver data
+ * @interval:	Requested report interval in milliseconds
+ *
+ * Clamps the interval to the range supported by the device.
+ * If the device is open, the sensor is re-enabled with the new
+ * interval and rescheduled accordingly. If the sensor rejects the
+ * new interval, the previous one is kept.
+ * The caller must hold the lock of the HID device driver data.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int hid_ll_set_interval(struct amd_sfh_hid_data *hid_data,
+			       u32 interval)
+{
+	u32 old = hid_data->settings.report_interval;
+	int rc;
+
+	if (!interval)
+		interval = AMD_SFH_UPDATE_INTERVAL;
+
+	interval = clamp_t(u32, interval, AMD_SFH_MIN_INTERVAL,
+			   amd_sfh_get_max_interval(hid_data->pci_dev));
+	if (interval == old)
+		return 0;
 
-	cancel_delayed_work_sync(&hid_data->work);
-	amd_sfh_stop_sensor(hid_data->pci_dev, hid_data->sensor_idx);
+	WRITE_ONCE(hid_data->settings.report_interval, interval);
+	if (!hid_data->sampling || hid_data->ops->sources)
+		return 0;
+
+	rc = amd_sfh_start_sensor(hid_data->pci_dev, hid_data->sensor_idx,
+				  hid_data->dma_handle, interval);
+	if (rc) {
+		WRITE_ONCE(hid_data->settings.report_interval, old);
+		return rc;
+	}
+
+	if (!hid_ll_irq(hid_data))
+		amd_sfh_sched_update(hid_data);
+
+	return 0;
 }
 
 /**
- * hid_ll_raw_request - Handles HID requests.
- * @hid:	HID device
+ * amd_sfh_hid_ll_set_interval - Changes the report interval of a sensor.
+ * @hid_data:	HID device driver data
+ * @interval:	Requested report interval in milliseconds
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+int amd_sfh_hid_ll_set_interval(struct amd_sfh_hid_data *hid_data,
+				u32 interval)
+{
+	int rc;
+
+	mutex_lock(&hid_data->lock);
+	rc = hid_ll_set_interval(hid_data, interval);
+	hid_ll_update_feature_report(hid_data);
+	mutex_unlock(&hid_data->lock);
+	return rc;
+}
+
+/**
+ * hid_ll_set_feature_report - Applies a feature report to a HID device.
+ * @hid_data:	HID device driver data
+ * @buf:	Report buffer
+ * @len:	Size of the report buffer
+ *
+ * Returns the amount of bytes processed on success or < zero on errors.
+ */
+static int hid_ll_set_feature_report(struct amd_sfh_hid_data *hid_data,
+				     u8 *buf, size_t len)
+{
+	struct sensor_settings settings;
+	int rc;
+
+	mutex_lock(&hid_data->lock);
+	settings = hid_data->settings;
+	rc = hid_data->ops->set_feature_report(buf, len, &settings);
+	if (!rc) {
+		memcpy(hid_data->settings.sensitivity, settings.sensitivity,
+		       sizeof(settings.sensitivity));
+		WRITE_ONCE(hid_data->settings.report_state,
+			   settings.report_state);
+		WRITE_ONCE(hid_data->settings.report_latency,
+			   settings.report_latency);
+		rc = hid_ll_set_interval(hid_data, settings.report_interval);
+		hid_ll_update_feature_report(hid_data);
+	}
+
+	mutex_unlock(&hid_data->lock);
+	if (rc)
+		return rc;
+
+	return len;
+}
+
+/**
+ * hid_ll_request - Handles HID requests.
+ * @hid_data:	HID device driver data
  * @reportnum:	HID report ID
  * @buf:	Write buffer for HID data
  * @len:	Size of the write buffer
  * @rtype:	Report type
  * @reqtype:	Request type
+ * @sample:	Sample read for input reports
  *
- * Delegates to the reporting functions
- * defined in amd-sfh-hid-descriptor.h.
+ * Delegates get requests to the operations of the sensor
+ * type and applies feature reports set by the host.
  */
-static int hid_ll_raw_request(struct hid_device *hid, unsigned char reportnum, u8 *buf,
-		       size_t len, unsigned char rtype, int reqtype)
+static int hid_ll_request(struct amd_sfh_hid_data *hid_data,
+			  unsigned char reportnum, u8 *buf, size_t len,
+			  unsigned char rtype, int reqtype,
+			  struct sensor_sample *sample)
 {
-	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	int rc;
+
+	switch (reqtype) {
+	case HID_REQ_GET_REPORT:
+		break;
+	case HID_REQ_SET_REPORT:
+		if (rtype != HID_FEATURE_REPORT)
+			return -EINVAL;
 
-	if (reqtype != HID_REQ_GET_REPORT)
+		return hid_ll_set_feature_report(hid_data, buf, len);
+	default:
 		return -EINVAL;
+	}
 
 	switch (rtype) {
 	case HID_FEATURE_REPORT:
-		switch (hid_data->sensor_idx) {
-		case ACCEL_IDX:
-			return get_accel_feature_report(reportnum, buf, len);
-		case ALS_IDX:
-			return get_als_feature_report(reportnum, buf, len);
-		case GYRO_IDX:
-			return get_gyro_feature_report(reportnum, buf, len);
-		case LID_IDX:
-			return get_lid_feature_report(reportnum, buf, len);
-		case MAG_IDX:
-			return get_mag_feature_report(reportnum, buf, len);
-		default:
-			return -EINVAL;
-		}
+		return hid_ll_get_feature_report(hid_data, reportnum, buf, len);
 	case HID_INPUT_REPORT:
-		switch (hid_data->sensor_idx) {
-		case ACCEL_IDX:
-			return get_accel_input_report(reportnum, buf, len,
-						      hid_data->cpu_addr);
-		case ALS_IDX:
-			return get_als_input_report(reportnum, buf, len,
-						    hid_data->cpu_addr,
-						    hid_data->pci_dev,
-						    hid_data->version);
-		case GYRO_IDX:
-			return get_gyro_input_report(reportnum, buf, len,
-						     hid_data->cpu_addr);
-		case LID_IDX:
-			return get_lid_input_report(reportnum, buf, len,
-						    hid_data->cpu_addr);
-		case MAG_IDX:
-			return get_mag_input_report(reportnum, buf, len,
-						    hid_data->cpu_addr);
-		default:
-			return -EINVAL;
-		}
+		rc = amd_sfh_hid_ll_get_sample(hid_data, sample);
+		if (rc)
+			return rc;
+
+		return hid_data->ops->get_input_report(reportnum, buf, len,
+						       sample);
 	default:
 		return -EINVAL;
 	}
 }
 
+/**
+ * hid_ll_raw_request - Handles HID requests.
+ * @hid:	HID device
+ * @reportnum:	HID report ID
+ * @buf:	Write buffer for HID data
+ * @len:	Size of the write buffer
+ * @rtype:	Report type
+ * @reqtype:	Request type
+ *
+ * Traces and accounts the requests handled by hid_ll_request().
+ */
+static int hid_ll_raw_request(struct hid_device *hid, unsigned char reportnum, u8 *buf,
+		       size_t len, unsigned char rtype, int reqtype)
+{
+	struct amd_sfh_hid_data *hid_data = hid->driver_data;
+	struct sensor_sample sample = { .count = 0 };
+	ktime_t start = ktime_get();
+	int rc;
+
+	rc = hid_ll_request(hid_data, reportnum, buf, len, rtype, reqtype,
+			    &sample);
+	if (rc == -EIO && rtype == HID_INPUT_REPORT)
+		hid_data->stats.errors++;
+
+	hid_data->stats.request_elapsed_ns +=
+		ktime_to_ns(ktime_sub(ktime_get(), start));
+	trace_amd_sfh_raw_request(hid_data->sensor_idx, reportnum, rtype,
+				  reqtype, rc, &sample);
+	return rc;
+}
+
 /**
  * The HID low-level driver for SFH HID devices.
  */
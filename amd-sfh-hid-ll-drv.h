@@ -11,34 +11,133 @@
 #ifndef AMD_SFH_HID_LL_DRV_H
 #define AMD_SFH_HID_LL_DRV_H
 
+#include <linux/debugfs.h>
 #include <linux/hid.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/pci.h>
 #include <linux/types.h>
-#include <linux/workqueue.h>
 
 #include "amd-sfh.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define AMD_SFH_FIFO_SIZE	128
+
+/**
+ * struct amd_sfh_stats - Per HID device performance counters.
+ * @samples:		Input reports pushed to the HID core
+ * @duplicates:		Samples equal to the previous sample
+ * @missed:		Deadlines missed by at least one interval
+ * @errors:		Failed sensor reads
+ * @poll_elapsed_ns:	Time elapsed delivering input reports
+ * @request_elapsed_ns:	Time elapsed handling requests of the HID core
+ * @latency:		log2 histogram of the delay from deadline to sampling
+ * @interval:		log2 histogram of the time between two samples
+ * @last_delivery:	Time of the last sample passed to the FIFO
+ * @resume_time:	Time of the last system resume pending its first sample
+ * @resume_ns:		Delay from the last system resume to its first sample
+ */
+struct amd_sfh_stats {
+	u64 samples;
+	u64 duplicates;
+	u64 missed;
+	u64 errors;
+	u64 poll_elapsed_ns;
+	u64 request_elapsed_ns;
+	u64 latency[AMD_SFH_HIST_BUCKETS];
+	u64 interval[AMD_SFH_HIST_BUCKETS];
+	ktime_t last_delivery;
+	ktime_t resume_time;
+	u64 resume_ns;
+};
+
+struct iio_dev;
+struct input_dev;
 
 /**
  * struct amd_sfh_hid_data - Per HID device driver data.
- * @work:		Work buffer for device polling
- * @hid:		Backref to the hid device
+ * @hid:		Backref to the hid device or NULL if served otherwise
+ * @indio_dev:		IIO device serving the sensor or NULL
+ * @input:		Input device serving the sensor or NULL
  * @pci_dev:		Underlying PCI device
  * @sensor_idx:		Sensor index
+ * @ops:		Description and operations of the sensor type
  * @version		SFH hardware version
  * @cpu_addr:		DMA mapped CPU address
  * @dma_handle:		DMA handle
+ * @sampling:		Whether the sensor is read
+ * @opens:		Open references to the sensor's own device
+ * @users:		Open virtual sensors computed from the sensor
+ * @sources:		Bitmask of the sensors used by the open virtual sensor
+ * @suspended:		Whether the used sensor awaits its restart after
+ *			system sleep
+ * @lock:		Serializes opening, closing and settings changes
+ * @settings:		Sensor settings configured by the host
+ * @feature_report:	Feature report reflecting the sensor settings
+ * @feature_len:	Size of the feature report
+ * @report_buf:		Buffer for input reports pushed to the HID core
+ * @last_sample:	Sample of the last input report passed to the FIFO
+ * @fifo:		Samples batched for delivery to the HID core
+ * @fifo_lock:		Serializes submissions to and draining of the FIFO
+ * @batch_work:		Work draining the FIFO once the report latency passed
+ * @sched_node:		Entry in the scheduler's list of polled sensors
+ * @poll_interval:	Polling interval in milliseconds or zero to poll at
+ *			the report interval
+ * @deadline:		Time of the next poll
+ * @stats:		Performance counters
+ * @debugfs:		debugfs directory of the sensor
  */
 struct amd_sfh_hid_data {
-	struct delayed_work work;
 	struct hid_device *hid;
+	struct iio_dev *indio_dev;
+	struct input_dev *input;
 	struct pci_dev *pci_dev;
 	enum sensor_idx sensor_idx;
+	const struct amd_sfh_sensor_ops *ops;
 	u8 version;
 	u32 *cpu_addr;
 	dma_addr_t dma_handle;
+	bool sampling;
+	unsigned int opens;
+	unsigned int users;
+	unsigned long sources;
+	bool suspended;
+	struct mutex lock;
+	struct sensor_settings settings;
+	u8 feature_report[AMD_SFH_MAX_REPORT_SIZE];
+	int feature_len;
+	u8 report_buf[AMD_SFH_MAX_REPORT_SIZE];
+	struct sensor_sample last_sample;
+	DECLARE_KFIFO(fifo, struct sensor_sample, AMD_SFH_FIFO_SIZE);
+	struct mutex fifo_lock;
+	struct kthread_delayed_work batch_work;
+	struct list_head sched_node;
+	u32 poll_interval;
+	ktime_t deadline;
+	struct amd_sfh_stats stats;
+	struct dentry *debugfs;
 };
 
 /* The low-level driver for AMD SFH HID devices */
 extern struct hid_ll_driver amd_sfh_hid_ll_driver;
 
+void amd_sfh_hid_ll_init(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_hid_ll_deinit(struct amd_sfh_hid_data *hid_data);
+int amd_sfh_hid_ll_open(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_hid_ll_close(struct amd_sfh_hid_data *hid_data);
+int amd_sfh_hid_ll_get(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_hid_ll_put(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_hid_ll_suspend(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_hid_ll_resume(struct amd_sfh_hid_data *hid_data);
+int amd_sfh_hid_ll_set_interval(struct amd_sfh_hid_data *hid_data,
+				u32 interval);
+int amd_sfh_hid_ll_get_sample(struct amd_sfh_hid_data *hid_data,
+			      struct sensor_sample *sample);
+void amd_sfh_hid_ll_report(struct amd_sfh_hid_data *hid_data, ktime_t due);
+void amd_sfh_hid_ll_push(struct amd_sfh_hid_data *hid_data,
+			 const struct sensor_sample *sample, ktime_t due);
+
 #endif
@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub IIO backend
+ *
+ * Optionally registers the motion and light sensors of the SFH as IIO
+ * devices, which are fed directly from the DMA buffers instead of going
+ * through the HID sensor hub and its IIO drivers.
+ * The devices are named like their HID sensor hub counterparts, so that
+ * userspace picks them up without further configuration.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/delay.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/pci.h>
+#include <linux/timekeeping.h>
+#include <linux/version.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-iio.h"
+#include "amd-sfh-pci.h"
+#include "sensors/amd-sfh-sensors.h"
+
+static bool use_iio;
+module_param_named(iio, use_iio, bool, 0444);
+MODULE_PARM_DESC(iio, "Register sensors as IIO devices instead of HID devices");
+
+/* Longest wait for the first sample of a sensor enabled for a single read */
+#define AMD_SFH_IIO_READ_WAIT	AMD_SFH_UPDATE_INTERVAL
+
+#define AMD_SFH_IIO_CHAN(_type, _mod, _index) {				\
+	.type = (_type),						\
+	.modified = (_mod) != IIO_NO_MOD,				\
+	.channel2 = (_mod),						\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),			\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),		\
+	.info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),	\
+	.scan_index = (_index),						\
+	.scan_type = {							\
+		.sign = 's',						\
+		.realbits = 32,						\
+		.storagebits = 32,					\
+		.endianness = IIO_CPU,					\
+	},								\
+}
+
+/**
+ * struct amd_sfh_iio_data - Per IIO device driver data.
+ * @hid_data:	HID device driver data of the sensor
+ * @last_read:	Sample of the last single read or zero
+ * @scan:	Buffer for samples pushed to the IIO core
+ */
+struct amd_sfh_iio_data {
+	struct amd_sfh_hid_data *hid_data;
+	struct sensor_sample last_read;
+	struct {
+		s32 values[AMD_SFH_MAX_AXES];
+		s64 timestamp __aligned(8);
+	} scan;
+};
+
+/**
+ * struct amd_sfh_iio_sensor - IIO description of a sensor.
+ * @name:		IIO device name
+ * @channels:		IIO channels
+ * @num_channels:	Amount of IIO channels
+ * @scan_masks:		Available scan masks
+ * @scale:		Numerator and denominator of the values' scale
+ *
+ * The scales correspond to the unit exponents of
+ * the values in the respective HID report descriptor.
+ * Their denominators leave room for AMD_SFH_FW_MUL in high precision mode.
+ */
+struct amd_sfh_iio_sensor {
+	const char *name;
+	const struct iio_chan_spec *channels;
+	int num_channels;
+	const unsigned long *scan_masks;
+	int scale[2];
+};
+
+static const unsigned long amd_sfh_iio_scan_masks_1d[] = { BIT(0), 0 };
+static const unsigned long amd_sfh_iio_scan_masks_3d[] = { GENMASK(2, 0), 0 };
+
+static const struct iio_chan_spec amd_sfh_iio_accel_channels[] = {
+	AMD_SFH_IIO_CHAN(IIO_ACCEL, IIO_MOD_X, 0),
+	AMD_SFH_IIO_CHAN(IIO_ACCEL, IIO_MOD_Y, 1),
+	AMD_SFH_IIO_CHAN(IIO_ACCEL, IIO_MOD_Z, 2),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+static const struct iio_chan_spec amd_sfh_iio_gyro_channels[] = {
+	AMD_SFH_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_X, 0),
+	AMD_SFH_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Y, 1),
+	AMD_SFH_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Z, 2),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+static const struct iio_chan_spec amd_sfh_iio_mag_channels[] = {
+	AMD_SFH_IIO_CHAN(IIO_MAGN, IIO_MOD_X, 0),
+	AMD_SFH_IIO_CHAN(IIO_MAGN, IIO_MOD_Y, 1),
+	AMD_SFH_IIO_CHAN(IIO_MAGN, IIO_MOD_Z, 2),
+	IIO_CHAN_SOFT_TIMESTAMP(3),
+};
+
+static const struct iio_chan_spec amd_sfh_iio_als_channels[] = {
+	AMD_SFH_IIO_CHAN(IIO_LIGHT, IIO_NO_MOD, 0),
+	IIO_CHAN_SOFT_TIMESTAMP(1),
+};
+
+/* 10^-2 g in m/s^2, i.e. 0.0980665 */
+static const struct amd_sfh_iio_sensor amd_sfh_iio_accel = {
+	.name = "accel_3d",
+	.channels = amd_sfh_iio_accel_channels,
+	.num_channels = ARRAY_SIZE(amd_sfh_iio_accel_channels),
+	.scan_masks = amd_sfh_iio_scan_masks_3d,
+	.scale = { 196133, 2000000 },
+};
+
+/* 10^-2 degrees/s in rad/s, i.e. pi / 18000 with pi as 355 / 113 */
+static const struct amd_sfh_iio_sensor amd_sfh_iio_gyro = {
+	.name = "gyro_3d",
+	.channels = amd_sfh_iio_gyro_channels,
+	.num_channels = ARRAY_SIZE(amd_sfh_iio_gyro_channels),
+	.scan_masks = amd_sfh_iio_scan_masks_3d,
+	.scale = { 355, 2034000 },
+};
+
+/* 10^-3 gauss in gauss */
+static const struct amd_sfh_iio_sensor amd_sfh_iio_mag = {
+	.name = "magn_3d",
+	.channels = amd_sfh_iio_mag_channels,
+	.num_channels = ARRAY_SIZE(amd_sfh_iio_mag_channels),
+	.scan_masks = amd_sfh_iio_scan_masks_3d,
+	.scale = { 1, 1000 },
+};
+
+/* 10^-1 lux in lux */
+static const struct amd_sfh_iio_sensor amd_sfh_iio_als = {
+	.name = "als",
+	.channels = amd_sfh_iio_als_channels,
+	.num_channels = ARRAY_SIZE(amd_sfh_iio_als_channels),
+	.scan_masks = amd_sfh_iio_scan_masks_1d,
+	.scale = { 1, 10 },
+};
+
+/**
+ * get_iio_sensor - Returns the IIO description of a sensor.
+ * @sensor_idx:	The sensor's index
+ *
+ * Returns NULL if the sensor has no IIO counterpart.
+ */
+static const struct amd_sfh_iio_sensor *
+get_iio_sensor(enum sensor_idx sensor_idx)
+{
+	switch (sensor_idx) {
+	case ACCEL_IDX:
+		return &amd_sfh_iio_accel;
+	case GYRO_IDX:
+		return &amd_sfh_iio_gyro;
+	case MAG_IDX:
+		return &amd_sfh_iio_mag;
+	case ALS_IDX:
+		return &amd_sfh_iio_als;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * amd_sfh_iio_read_sample - Obtains a current sample of a sensor.
+ * @iio_data:	IIO device driver data
+ * @sample:	Sample to fill
+ *
+ * Must be called in direct mode, which serializes single reads.
+ * A sensor that is sampled anyway, e.g. for a virtual sensor, is read
+ * as is. Otherwise the sensor is enabled for one report interval, but for
+ * at most AMD_SFH_IIO_READ_WAIT milliseconds. With longer intervals, the
+ * firmware may not have written a new sample by then, so the value may be
+ * that of its last run. The sample is reused for as long as the wait took,
+ * so that reading all axes one after another enables the sensor once.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int amd_sfh_iio_read_sample(struct amd_sfh_iio_data *iio_data,
+				   struct sensor_sample *sample)
+{
+	struct amd_sfh_hid_data *hid_data = iio_data->hid_data;
+	u32 interval = READ_ONCE(hid_data->settings.report_interval);
+	struct sensor_sample *last = &iio_data->last_read;
+	int rc;
+
+	interval = min_t(u32, interval, AMD_SFH_IIO_READ_WAIT);
+
+	if (READ_ONCE(hid_data->sampling))
+		return amd_sfh_hid_ll_get_sample(hid_data, sample);
+
+	if (last->timestamp && ktime_get_boottime_ns() - last->timestamp <
+	    (u64)interval * NSEC_PER_MSEC) {
+		*sample = *last;
+		return 0;
+	}
+
+	rc = amd_sfh_hid_ll_open(hid_data);
+	if (rc)
+		return rc;
+
+	msleep(interval);
+	rc = amd_sfh_hid_ll_get_sample(hid_data, sample);
+	amd_sfh_hid_ll_close(hid_data);
+	if (!rc)
+		*last = *sample;
+
+	return rc;
+}
+
+/**
+ * amd_sfh_iio_read_value - Reads a single value of a sensor.
+ * @indio_dev:	IIO device
+ * @index:	Index of the value within the sensor's sample
+ * @val:	Read value
+ *
+ * Returns IIO_VAL_INT on success or < zero on errors.
+ */
+static int amd_sfh_iio_read_value(struct iio_dev *indio_dev, int index,
+				  int *val)
+{
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+	struct sensor_sample sample;
+	int rc;
+
+	rc = iio_device_claim_direct_mode(indio_dev);
+	if (rc)
+		return rc;
+
+	rc = amd_sfh_iio_read_sample(iio_data, &sample);
+	iio_device_release_direct_mode(indio_dev);
+	if (rc)
+		return rc;
+
+	if (index >= sample.count)
+		return -EINVAL;
+
+	*val = sample.values[index];
+	return IIO_VAL_INT;
+}
+
+static int amd_sfh_iio_read_raw(struct iio_dev *indio_dev,
+				struct iio_chan_spec const *chan,
+				int *val, int *val2, long mask)
+{
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+	struct amd_sfh_hid_data *hid_data = iio_data->hid_data;
+	const struct amd_sfh_iio_sensor *sensor;
+	u32 interval, uhz;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		return amd_sfh_iio_read_value(indio_dev, chan->scan_index, val);
+	case IIO_CHAN_INFO_SCALE:
+		sensor = get_iio_sensor(hid_data->sensor_idx);
+		*val = sensor->scale[0];
+		*val2 = sensor->scale[1];
+		if (amd_sfh_high_precision)
+			*val2 *= AMD_SFH_FW_MUL;
+
+		return IIO_VAL_FRACTIONAL;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		interval = READ_ONCE(hid_data->settings.report_interval);
+		uhz = NSEC_PER_SEC / interval;
+		*val = uhz / USEC_PER_SEC;
+		*val2 = uhz % USEC_PER_SEC;
+		return IIO_VAL_INT_PLUS_MICRO;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int amd_sfh_iio_write_raw(struct iio_dev *indio_dev,
+				 struct iio_chan_spec const *chan,
+				 int val, int val2, long mask)
+{
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+	u64 uhz, interval;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		if (val < 0 || val2 < 0)
+			return -EINVAL;
+
+		uhz = (u64)val * USEC_PER_SEC + val2;
+		if (!uhz)
+			return -EINVAL;
+
+		interval = max_t(u64, div64_u64(NSEC_PER_SEC, uhz),
+				 AMD_SFH_MIN_INTERVAL);
+		return amd_sfh_hid_ll_set_interval(iio_data->hid_data,
+						   interval);
+	default:
+		return -EINVAL;
+	}
+}
+
+static const struct iio_info amd_sfh_iio_info = {
+	.read_raw = amd_sfh_iio_read_raw,
+	.write_raw = amd_sfh_iio_write_raw,
+};
+
+/**
+ * amd_sfh_iio_buffer_postenable - Enables a sensor along with its buffer.
+ * @indio_dev:	IIO device
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int amd_sfh_iio_buffer_postenable(struct iio_dev *indio_dev)
+{
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+
+	return amd_sfh_hid_ll_open(iio_data->hid_data);
+}
+
+/**
+ * amd_sfh_iio_buffer_predisable - Disables a sensor along with its buffer.
+ * @indio_dev:	IIO device
+ *
+ * Returns 0.
+ */
+static int amd_sfh_iio_buffer_predisable(struct iio_dev *indio_dev)
+{
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+
+	amd_sfh_hid_ll_close(iio_data->hid_data);
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops amd_sfh_iio_buffer_ops = {
+	.postenable = amd_sfh_iio_buffer_postenable,
+	.predisable = amd_sfh_iio_buffer_predisable,
+};
+
+/**
+ * amd_sfh_iio_buffer_setup - Attaches a software buffer to an IIO device.
+ * @dev:	Parent device
+ * @indio_dev:	IIO device
+ *
+ * Samples are pushed by the SFH, so no trigger is involved.
+ * Kernels before 5.13 do not provide devm_iio_kfifo_buffer_setup().
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int amd_sfh_iio_buffer_setup(struct device *dev,
+				    struct iio_dev *indio_dev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 13, 0)
+	return devm_iio_kfifo_buffer_setup(dev, indio_dev,
+					   INDIO_BUFFER_SOFTWARE,
+					   &amd_sfh_iio_buffer_ops);
+#else
+	struct iio_buffer *buffer;
+
+	buffer = devm_iio_kfifo_allocate(dev);
+	if (!buffer)
+		return -ENOMEM;
+
+	indio_dev->modes |= INDIO_BUFFER_SOFTWARE;
+	indio_dev->setup_ops = &amd_sfh_iio_buffer_ops;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	return iio_device_attach_buffer(indio_dev, buffer);
+#else
+	iio_device_attach_buffer(indio_dev, buffer);
+	return 0;
+#endif
+#endif
+}
+
+/**
+ * amd_sfh_iio_supported - Checks whether the IIO backend serves a sensor.
+ * @sensor_idx:	The sensor's index
+ */
+bool amd_sfh_iio_supported(enum sensor_idx sensor_idx)
+{
+	return use_iio && get_iio_sensor(sensor_idx);
+}
+
+/**
+ * amd_sfh_iio_init - Registers an IIO device for a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Returns 0 on success and non-zero on errors.
+ */
+int amd_sfh_iio_init(struct amd_sfh_hid_data *hid_data)
+{
+	const struct amd_sfh_iio_sensor *sensor;
+	struct device *dev = &hid_data->pci_dev->dev;
+	struct amd_sfh_iio_data *iio_data;
+	struct iio_dev *indio_dev;
+	int rc;
+
+	sensor = get_iio_sensor(hid_data->sensor_idx);
+	if (!sensor)
+		return -ENODEV;
+
+	indio_dev = devm_iio_device_alloc(dev, sizeof(*iio_data));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	iio_data = iio_priv(indio_dev);
+	iio_data->hid_data = hid_data;
+	indio_dev->dev.parent = dev;
+	indio_dev->name = sensor->name;
+	indio_dev->info = &amd_sfh_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = sensor->channels;
+	indio_dev->num_channels = sensor->num_channels;
+	indio_dev->available_scan_masks = sensor->scan_masks;
+
+	rc = amd_sfh_iio_buffer_setup(dev, indio_dev);
+	if (rc)
+		return rc;
+
+	amd_sfh_hid_ll_init(hid_data);
+	hid_data->indio_dev = indio_dev;
+	rc = iio_device_register(indio_dev);
+	if (rc) {
+		hid_data->indio_dev = NULL;
+		amd_sfh_hid_ll_deinit(hid_data);
+		pci_err(hid_data->pci_dev,
+			"Failed to register IIO device: %d\n", rc);
+	}
+
+	return rc;
+}
+
+/**
+ * amd_sfh_iio_deinit - Unregisters the IIO device of a sensor.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_iio_deinit(struct amd_sfh_hid_data *hid_data)
+{
+	iio_device_unregister(hid_data->indio_dev);
+	amd_sfh_hid_ll_deinit(hid_data);
+	hid_data->indio_dev = NULL;
+}
+
+/**
+ * amd_sfh_iio_push - Pushes a sample to the IIO buffer.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ */
+void amd_sfh_iio_push(struct amd_sfh_hid_data *hid_data,
+		      const struct sensor_sample *sample)
+{
+	struct iio_dev *indio_dev = hid_data->indio_dev;
+	struct amd_sfh_iio_data *iio_data = iio_priv(indio_dev);
+
+	if (!iio_buffer_enabled(indio_dev))
+		return;
+
+	memcpy(iio_data->scan.values, sample->values,
+	       sizeof(iio_data->scan.values));
+	iio_push_to_buffers_with_timestamp(indio_dev, &iio_data->scan,
+					   sample->timestamp);
+}
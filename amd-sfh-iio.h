@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub IIO backend interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_IIO_H
+#define AMD_SFH_IIO_H
+
+#include <linux/errno.h>
+#include <linux/kconfig.h>
+#include <linux/types.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#if IS_ENABLED(CONFIG_AMD_SFH_IIO)
+bool amd_sfh_iio_supported(enum sensor_idx sensor_idx);
+int amd_sfh_iio_init(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_iio_deinit(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_iio_push(struct amd_sfh_hid_data *hid_data,
+		      const struct sensor_sample *sample);
+#else
+static inline bool amd_sfh_iio_supported(enum sensor_idx sensor_idx)
+{
+	return false;
+}
+
+static inline int amd_sfh_iio_init(struct amd_sfh_hid_data *hid_data)
+{
+	return -ENODEV;
+}
+
+static inline void amd_sfh_iio_deinit(struct amd_sfh_hid_data *hid_data)
+{
+}
+
+static inline void amd_sfh_iio_push(struct amd_sfh_hid_data *hid_data,
+				    const struct sensor_sample *sample)
+{
+}
+#endif
+
+#endif
@@ -0,0 +1,460 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub input backend
+ *
+ * Registers the lid switch of the SFH as input device, which reports
+ * SW_LID events on transitions of the lid state only.
+ * The lid state is delivered by interrupts if available and polled
+ * at a slow interval otherwise, since it rarely changes.
+ *
+ * On convertibles, whose lid switch also closes when the screen is
+ * folded back, the device additionally reports SW_TABLET_MODE.
+ * Whether the closed lid means tablet mode is decided by the
+ * accelerometer in the screen: the screen of a closed laptop faces
+ * downwards, while that of a tablet does not. The accelerometer
+ * is only kept sampled from the closing of the lid until then.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/input.h>
+#include <linux/pci.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/time64.h>
+#include <linux/workqueue.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-input.h"
+#include "amd-sfh-pci.h"
+#include "amd-sfh-quirks.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define AMD_SFH_INPUT_INTERVAL	1000
+#define AMD_SFH_INPUT_DEBOUNCE	(500 * NSEC_PER_MSEC)
+
+/**
+ * enum amd_sfh_lid_mode - Modes reported by the input device.
+ * @AMD_SFH_LID_OPEN:	The lid is open
+ * @AMD_SFH_LID_CLOSED:	The lid is closed onto the keyboard
+ * @AMD_SFH_LID_TABLET:	The lid is folded back onto the keyboard's bottom
+ */
+enum amd_sfh_lid_mode {
+	AMD_SFH_LID_OPEN = 0,
+	AMD_SFH_LID_CLOSED,
+	AMD_SFH_LID_TABLET,
+};
+
+/**
+ * struct amd_sfh_input - Per input device driver data.
+ * @hid_data:	HID device driver data of the lid switch
+ * @accel:	HID device driver data of the accelerometer or NULL
+ *		if the tablet mode is not reported
+ * @input:	Input device
+ * @lock:	Serializes updates by the lid switch and the accelerometer
+ * @accel_work:	Work getting and putting the accelerometer as needed
+ * @open:	Whether the input device is open
+ * @tablet:	Whether the accelerometer is sampled to decide the mode
+ * @no_tablet:	Whether the accelerometer failed to start since the lid
+ *		was last open
+ * @closed:	Whether the lid switch is closed
+ * @has_face:	Whether @face_down is valid
+ * @face_down:	Whether the screen faces downwards
+ * @mode:	Reported mode
+ * @next:	Mode waiting for the debounce time
+ * @next_time:	Timestamp since which @next is determined or zero
+ */
+struct amd_sfh_input {
+	struct amd_sfh_hid_data *hid_data;
+	struct amd_sfh_hid_data *accel;
+	struct input_dev *input;
+	spinlock_t lock;
+	struct work_struct accel_work;
+	bool open;
+	bool tablet;
+	bool no_tablet;
+	bool closed;
+	bool has_face;
+	bool face_down;
+	enum amd_sfh_lid_mode mode;
+	enum amd_sfh_lid_mode next;
+	u64 next_time;
+};
+
+/**
+ * input_sensor - Returns the HID device driver data of a sensor.
+ * @privdata:	SFH driver data
+ * @sensor_idx:	Index of the sensor
+ *
+ * Returns NULL if the SFH does not serve the sensor.
+ */
+static struct amd_sfh_hid_data *input_sensor(struct amd_sfh_data *privdata,
+					     enum sensor_idx sensor_idx)
+{
+	int i;
+
+	for (i = 0; i < AMD_SFH_MAX_SENSORS; i++) {
+		if (privdata->sensors[i] &&
+		    privdata->sensors[i]->sensor_idx == sensor_idx)
+			return privdata->sensors[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * input_tablet_accel - Returns the accelerometer deciding the tablet mode.
+ * @hid_data:	HID device driver data of the lid switch
+ *
+ * Returns NULL unless the system is a convertible with an accelerometer.
+ */
+static struct amd_sfh_hid_data *
+input_tablet_accel(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_quirks *quirks = amd_sfh_get_quirks();
+
+	if (!quirks || !quirks->tablet_mode)
+		return NULL;
+
+	return input_sensor(privdata, ACCEL_IDX);
+}
+
+/**
+ * input_deciding - Checks whether the accelerometer decides the mode.
+ * @state:	Input device driver data
+ *
+ * Must be called with the state's lock held.
+ * Returns true from the closing of the lid until a mode was reported,
+ * unless the system is no convertible or its accelerometer failed.
+ */
+static bool input_deciding(struct amd_sfh_input *state)
+{
+	return state->accel && !state->no_tablet && state->closed &&
+	       state->mode == AMD_SFH_LID_OPEN;
+}
+
+/**
+ * input_advance - Determines the mode to be reported.
+ * @state:	Input device driver data
+ * @timestamp:	Timestamp of the sample that changed the state
+ *
+ * Must be called with the state's lock held.
+ * An open lid is reported immediately. A closed lid keeps its mode until
+ * it opens again. Without accelerometer, it is reported as closed
+ * immediately. Otherwise the mode must be determined by the accelerometer
+ * for the debounce time, so that the screen settled when the lid closed.
+ * Returns true if the reported mode changed.
+ */
+static bool input_advance(struct amd_sfh_input *state, u64 timestamp)
+{
+	enum amd_sfh_lid_mode next;
+	bool deciding = input_deciding(state);
+
+	if (!state->closed)
+		next = AMD_SFH_LID_OPEN;
+	else if (state->mode != AMD_SFH_LID_OPEN)
+		return false;
+	else if (!deciding)
+		next = AMD_SFH_LID_CLOSED;
+	else if (!state->tablet || !state->has_face)
+		return false;
+	else if (state->face_down)
+		next = AMD_SFH_LID_CLOSED;
+	else
+		next = AMD_SFH_LID_TABLET;
+
+	if (next == state->mode) {
+		state->next_time = 0;
+		return false;
+	}
+
+	if (deciding) {
+		if (!state->next_time || next != state->next) {
+			state->next = next;
+			state->next_time = timestamp;
+		}
+
+		if (timestamp - state->next_time < AMD_SFH_INPUT_DEBOUNCE)
+			return false;
+	}
+
+	state->mode = next;
+	state->next_time = 0;
+	if (next == AMD_SFH_LID_OPEN)
+		state->no_tablet = false;
+
+	return true;
+}
+
+/**
+ * input_update - Advances the reported mode.
+ * @state:	Input device driver data
+ * @timestamp:	Timestamp of the sample that changed the state
+ *
+ * Must be called with the state's lock held.
+ * Queues the work getting or putting the accelerometer once the
+ * lid closed, a mode has been decided or the lid opened again.
+ * Returns true if the reported mode changed.
+ */
+static bool input_update(struct amd_sfh_input *state, u64 timestamp)
+{
+	bool changed = input_advance(state, timestamp);
+
+	if (state->open && input_deciding(state) != state->tablet)
+		schedule_work(&state->accel_work);
+
+	return changed;
+}
+
+/**
+ * input_report - Reports the mode as switch events.
+ * @state:	Input device driver data
+ *
+ * Must be called with the state's lock held, so that
+ * the events are reported in the order of the changes.
+ */
+static void input_report(struct amd_sfh_input *state)
+{
+	enum amd_sfh_lid_mode mode = state->mode;
+
+	input_report_switch(state->input, SW_LID, mode == AMD_SFH_LID_CLOSED);
+	if (state->accel)
+		input_report_switch(state->input, SW_TABLET_MODE,
+				    mode == AMD_SFH_LID_TABLET);
+
+	input_sync(state->input);
+}
+
+/**
+ * input_accel_work - Gets or puts the accelerometer as needed.
+ * @work:	Work of the input device driver data
+ *
+ * Starting and stopping the accelerometer sleeps, so it cannot be done
+ * from the scheduler's worker delivering the samples. If the accelerometer
+ * fails to start, the closed lid is reported without tablet mode.
+ */
+static void input_accel_work(struct work_struct *work)
+{
+	struct amd_sfh_input *state;
+	bool deciding, report;
+	int rc;
+
+	state = container_of(work, struct amd_sfh_input, accel_work);
+	for (;;) {
+		spin_lock(&state->lock);
+		deciding = state->open && input_deciding(state);
+		spin_unlock(&state->lock);
+		if (deciding == state->tablet)
+			return;
+
+		if (!deciding) {
+			spin_lock(&state->lock);
+			WRITE_ONCE(state->tablet, false);
+			spin_unlock(&state->lock);
+			amd_sfh_hid_ll_put(state->accel);
+			continue;
+		}
+
+		rc = amd_sfh_hid_ll_get(state->accel);
+		if (rc)
+			pci_warn(state->hid_data->pci_dev,
+				 "Tablet mode unavailable: %d\n", rc);
+
+		spin_lock(&state->lock);
+		state->has_face = false;
+		state->next_time = 0;
+		if (rc)
+			state->no_tablet = true;
+		else
+			WRITE_ONCE(state->tablet, true);
+
+		report = rc && input_update(state, ktime_get_boottime_ns());
+		if (report)
+			input_report(state);
+
+		spin_unlock(&state->lock);
+	}
+}
+
+static int amd_sfh_input_open(struct input_dev *input)
+{
+	struct amd_sfh_input *state = input_get_drvdata(input);
+	int rc;
+
+	spin_lock(&state->lock);
+	state->open = true;
+	state->no_tablet = false;
+	spin_unlock(&state->lock);
+
+	rc = amd_sfh_hid_ll_open(state->hid_data);
+	if (rc) {
+		spin_lock(&state->lock);
+		state->open = false;
+		spin_unlock(&state->lock);
+	}
+
+	return rc;
+}
+
+static void amd_sfh_input_close(struct input_dev *input)
+{
+	struct amd_sfh_input *state = input_get_drvdata(input);
+
+	amd_sfh_hid_ll_close(state->hid_data);
+	spin_lock(&state->lock);
+	state->open = false;
+	spin_unlock(&state->lock);
+
+	/* Puts the accelerometer if it is still used */
+	schedule_work(&state->accel_work);
+	flush_work(&state->accel_work);
+}
+
+/**
+ * amd_sfh_input_supported - Checks whether the input backend serves a sensor.
+ * @sensor_idx:	The sensor's index
+ */
+bool amd_sfh_input_supported(enum sensor_idx sensor_idx)
+{
+	return sensor_idx == LID_IDX;
+}
+
+/**
+ * amd_sfh_input_init - Registers an input device for a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Must be called after the accelerometer was registered.
+ * Returns 0 on success and non-zero on errors.
+ */
+int amd_sfh_input_init(struct amd_sfh_hid_data *hid_data)
+{
+	struct pci_dev *pci_dev = hid_data->pci_dev;
+	struct amd_sfh_input *state;
+	struct input_dev *input;
+	int rc;
+
+	if (!amd_sfh_input_supported(hid_data->sensor_idx))
+		return -ENODEV;
+
+	state = devm_kzalloc(&pci_dev->dev, sizeof(*state), GFP_KERNEL);
+	if (!state)
+		return -ENOMEM;
+
+	input = devm_input_allocate_device(&pci_dev->dev);
+	if (!input)
+		return -ENOMEM;
+
+	state->hid_data = hid_data;
+	state->accel = input_tablet_accel(hid_data);
+	state->input = input;
+	spin_lock_init(&state->lock);
+	INIT_WORK(&state->accel_work, input_accel_work);
+
+	input->name = "AMD Sensor Fusion Hub lid switch";
+	input->phys = pci_name(pci_dev);
+	input->id.bustype = BUS_PCI;
+	input->id.vendor = pci_dev->vendor;
+	input->id.product = pci_dev->device;
+	input->open = amd_sfh_input_open;
+	input->close = amd_sfh_input_close;
+	input_set_capability(input, EV_SW, SW_LID);
+	if (state->accel)
+		input_set_capability(input, EV_SW, SW_TABLET_MODE);
+
+	input_set_drvdata(input, state);
+
+	/* The firmware may not support intervals as long as the polling's */
+	hid_data->settings.report_interval =
+		min_t(u32, AMD_SFH_INPUT_INTERVAL,
+		      amd_sfh_get_max_interval(pci_dev));
+	hid_data->poll_interval = AMD_SFH_INPUT_INTERVAL;
+	amd_sfh_hid_ll_init(hid_data);
+	hid_data->input = input;
+	rc = input_register_device(input);
+	if (rc) {
+		hid_data->input = NULL;
+		amd_sfh_hid_ll_deinit(hid_data);
+		pci_err(pci_dev, "Failed to register input device: %d\n", rc);
+	}
+
+	return rc;
+}
+
+/**
+ * amd_sfh_input_deinit - Unregisters the input device of a sensor.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_input_deinit(struct amd_sfh_hid_data *hid_data)
+{
+	input_unregister_device(hid_data->input);
+	amd_sfh_hid_ll_deinit(hid_data);
+	hid_data->input = NULL;
+}
+
+/**
+ * amd_sfh_input_push - Reports a sample as switch event.
+ * @hid_data:	HID device driver data
+ * @sample:	Sensor sample
+ *
+ * Samples which do not change the reported mode are dropped.
+ */
+void amd_sfh_input_push(struct amd_sfh_hid_data *hid_data,
+			const struct sensor_sample *sample)
+{
+	struct amd_sfh_input *state = input_get_drvdata(hid_data->input);
+
+	if (!sample->count)
+		return;
+
+	spin_lock(&state->lock);
+	state->closed = sample->values[0];
+	if (input_update(state, sample->timestamp))
+		input_report(state);
+
+	spin_unlock(&state->lock);
+}
+
+/**
+ * amd_sfh_input_update - Updates the input devices with a sample.
+ * @hid_data:	HID device driver data of the sampled sensor
+ * @sample:	Sensor sample
+ *
+ * Accelerometer samples tell where the screen faces, while the
+ * mode of a convertible's closed lid is being decided.
+ */
+void amd_sfh_input_update(struct amd_sfh_hid_data *hid_data,
+			  const struct sensor_sample *sample)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_hid_data *lid;
+	struct amd_sfh_input *state;
+	struct input_dev *input;
+	s64 x, y, z;
+
+	if (hid_data->sensor_idx != ACCEL_IDX || !READ_ONCE(hid_data->users))
+		return;
+
+	lid = input_sensor(privdata, LID_IDX);
+	input = lid ? READ_ONCE(lid->input) : NULL;
+	if (!input)
+		return;
+
+	state = input_get_drvdata(input);
+	if (state->accel != hid_data || !READ_ONCE(state->tablet))
+		return;
+
+	/* A screen facing down has the accelerometer along its Z axis */
+	x = sample->values[0];
+	y = sample->values[1];
+	z = sample->values[2];
+
+	spin_lock(&state->lock);
+	state->face_down = z > 0 && 2 * z * z > x * x + y * y + z * z;
+	state->has_face = true;
+	if (input_update(state, sample->timestamp))
+		input_report(state);
+
+	spin_unlock(&state->lock);
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub input backend interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_INPUT_H
+#define AMD_SFH_INPUT_H
+
+#include <linux/types.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "sensors/amd-sfh-sensors.h"
+
+bool amd_sfh_input_supported(enum sensor_idx sensor_idx);
+int amd_sfh_input_init(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_input_deinit(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_input_push(struct amd_sfh_hid_data *hid_data,
+			const struct sensor_sample *sample);
+void amd_sfh_input_update(struct amd_sfh_hid_data *hid_data,
+			  const struct sensor_sample *sample);
+
+#endif
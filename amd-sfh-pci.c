@@ -9,16 +9,28 @@
 
 #include <linux/bitops.h>
 #include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
 #include <linux/io-64-nonatomic-lo-hi.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
+#include <linux/mutex.h>
 #include <linux/pci.h>
+#include <linux/pm.h>
+#include <linux/pm_runtime.h>
 #include <linux/types.h>
 
 #include "amd-sfh.h"
+#include "amd-sfh-cdev.h"
 #include "amd-sfh-client.h"
+#include "amd-sfh-debugfs.h"
 #include "amd-sfh-pci.h"
 #include "amd-sfh-quirks.h"
+#include "amd-sfh-sched.h"
+
+#define CREATE_TRACE_POINTS
+#include "amd-sfh-trace.h"
 
 #define DRIVER_NAME		"amd_sfh"
 #define PCI_DEVICE_ID_AMD_SFH	0x15E4
@@ -28,6 +40,33 @@ static uint sensor_mask_override;
 module_param_named(sensor_mask, sensor_mask_override, uint, 0644);
 MODULE_PARM_DESC(sensor_mask, "override the sensors bitmask");
 
+static bool use_interrupts;
+module_param_named(interrupts, use_interrupts, bool, 0444);
+MODULE_PARM_DESC(interrupts,
+		 "use interrupts instead of polling if supported (experimental)");
+
+/**
+ * amd_sfh_select_sensor_mask - Chooses the effective sensors mask.
+ * @sensor_mask:	Sensors mask reported by the firmware
+ * @override:		Sensors mask of the module parameter or zero
+ * @quirks:		Quirks of the system or NULL
+ *
+ * The module parameter takes precedence over the quirks,
+ * which take precedence over the firmware.
+ */
+uint amd_sfh_select_sensor_mask(uint sensor_mask, uint override,
+				const struct amd_sfh_quirks *quirks)
+{
+	if (override)
+		return override;
+
+	if (quirks)
+		return quirks->sensor_mask;
+
+	return sensor_mask;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_select_sensor_mask);
+
 /**
  * amd_sfh_get_sensor_mask - Returns the sensors mask.
  * @pci_dev:	The Sensor Fusion Hub PCI device
@@ -38,7 +77,6 @@ MODULE_PARM_DESC(sensor_mask, "override the sensors bitmask");
 uint amd_sfh_get_sensor_mask(struct pci_dev *pci_dev)
 {
 	struct amd_sfh_data *privdata;
-	struct amd_sfh_quirks *quirks;
 	uint sensor_mask;
 
 	privdata = pci_get_drvdata(pci_dev);
@@ -48,15 +86,55 @@ uint amd_sfh_get_sensor_mask(struct pci_dev *pci_dev)
 	if (!sensor_mask)
 		pci_err(pci_dev, "[Firmware Bug]: No sensors marked active!\n");
 
-	if (sensor_mask_override)
-		return sensor_mask_override;
+	return amd_sfh_select_sensor_mask(sensor_mask, sensor_mask_override,
+					  amd_sfh_get_quirks());
+}
 
-	quirks = amd_sfh_get_quirks();
-	if (quirks)
-		return quirks->sensor_mask;
+/**
+ * amd_sfh_get_dma_slots - Claims the DMA slots of a sensor.
+ * @pci_dev:	Sensor Fusion Hub PCI device
+ * @dma_handle:	Returns the DMA handle of the sensor's first slot
+ *
+ * Hands out the per-sensor parts of the DMA memory shared by all sensors.
+ * The firmware writes to the first slot of a sensor.
+ *
+ * Returns the CPU address of the sensor's first slot
+ * or NULL if all slots have been claimed.
+ */
+u32 *amd_sfh_get_dma_slots(struct pci_dev *pci_dev, dma_addr_t *dma_handle)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(pci_dev);
+	size_t offset;
+	int i;
+
+	for (i = 0; i < AMD_SFH_MAX_SENSORS; i++) {
+		if (test_and_set_bit(i, &privdata->dma_used))
+			continue;
+
+		offset = i * AMD_SFH_DMA_SENSOR_SIZE;
+		memset(privdata->dma_cpu_addr + offset, 0,
+		       AMD_SFH_DMA_SENSOR_SIZE);
+		*dma_handle = privdata->dma_handle + offset;
+		return privdata->dma_cpu_addr + offset;
+	}
 
-	return sensor_mask;
+	return NULL;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_get_dma_slots);
+
+/**
+ * amd_sfh_put_dma_slots - Releases the DMA slots of a sensor.
+ * @pci_dev:	Sensor Fusion Hub PCI device
+ * @cpu_addr:	CPU address returned by amd_sfh_get_dma_slots()
+ */
+void amd_sfh_put_dma_slots(struct pci_dev *pci_dev, u32 *cpu_addr)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(pci_dev);
+	size_t offset = (void *)cpu_addr - privdata->dma_cpu_addr;
+
+	clear_bit(offset / AMD_SFH_DMA_SENSOR_SIZE, &privdata->dma_used);
 }
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_put_dma_slots);
 
 /**
  * amd_sfh_get_version - Returns the hardware version.
@@ -79,14 +157,130 @@ int amd_sfh_get_illuminance(struct pci_dev *pci_dev)
 	return (int)readl(privdata->mmio + AMD_C2P_MSG5);
 }
 
+/**
+ * amd_sfh_get_max_interval - Returns the maximum update interval.
+ * @pci_dev:	Sensor Fusion Hub PCI device
+ *
+ * Returns the largest update interval in milliseconds
+ * that fits into the command register of the device.
+ */
+u32 amd_sfh_get_max_interval(struct pci_dev *pci_dev)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(pci_dev);
+
+	switch (privdata->version) {
+	case AMD_SFH_HWID_V2:
+		return U8_MAX;
+	default:
+		return U16_MAX;
+	}
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_get_max_interval);
+
+/**
+ * amd_sfh_wait_response - Waits for the firmware to acknowledge a command.
+ * @privdata:	SFH driver data
+ * @cmd:	Command sent to the firmware
+ *
+ * Only V2 firmware reports the result of enabling
+ * and disabling sensors in the P2C response register.
+ *
+ * Returns 0 on success or -ETIMEDOUT if no matching response arrived.
+ */
+static int amd_sfh_wait_response(struct amd_sfh_data *privdata,
+				 union amd_sfh_cmd cmd)
+{
+	union amd_sfh_cmd_response resp;
+	u8 expected;
+
+	if (cmd.cmd_v2.cmd_id == AMD_SFH_CMD_ENABLE_SENSOR)
+		expected = AMD_SFH_RESP_SENSOR_ENABLED;
+	else
+		expected = AMD_SFH_RESP_SENSOR_DISABLED;
+
+	return readl_poll_timeout(privdata->mmio + AMD_P2C_MSG0, resp.ul,
+				  !resp.s.status &&
+				  resp.s.response == expected &&
+				  resp.s.sensor_id == cmd.cmd_v2.sensor_id,
+				  AMD_SFH_CMD_POLL_US, AMD_SFH_CMD_TIMEOUT_US);
+}
+
+/**
+ * amd_sfh_send_cmd - Sends a command through the C2P mailbox registers.
+ * @privdata:	SFH driver data
+ * @cmd:	Command
+ * @parm:	Command parameters
+ * @dma_handle:	DMA handle or zero
+ * @ack:	Whether the firmware acknowledges the command
+ *
+ * Commands are serialized, since the mailbox holds one command at a time.
+ * Acknowledged commands are resent up to AMD_SFH_CMD_RETRIES times
+ * if the firmware does not respond in time.
+ *
+ * Returns 0 on success or -ETIMEDOUT if the command was not acknowledged.
+ */
+static int amd_sfh_send_cmd(struct amd_sfh_data *privdata,
+			    union amd_sfh_cmd cmd, union amd_sfh_parm parm,
+			    dma_addr_t dma_handle, bool ack)
+{
+	struct amd_sfh_cmd_stats *stats = &privdata->cmd_stats;
+	unsigned int retries = 0;
+	ktime_t start, latency;
+	int rc = 0;
+
+	mutex_lock(&privdata->cmd_lock);
+	start = ktime_get();
+	for (;;) {
+		trace_amd_sfh_cmd(privdata->version, cmd, parm, dma_handle);
+
+		/* Do not mistake the response to a former command for ours */
+		if (ack)
+			writel(0, privdata->mmio + AMD_P2C_MSG0);
+
+		writeq(dma_handle, privdata->mmio + AMD_C2P_MSG2);
+		writel(parm.ul, privdata->mmio + AMD_C2P_MSG1);
+		writel(cmd.ul, privdata->mmio + AMD_C2P_MSG0);
+		if (!ack)
+			break;
+
+		rc = amd_sfh_wait_response(privdata, cmd);
+		if (!rc || retries == AMD_SFH_CMD_RETRIES)
+			break;
+
+		retries++;
+	}
+
+	latency = ktime_sub(ktime_get(), start);
+	stats->commands++;
+	stats->retries += retries;
+	if (rc)
+		stats->timeouts++;
+	else
+		amd_sfh_hist_add(stats->latency, latency);
+
+	mutex_unlock(&privdata->cmd_lock);
+	trace_amd_sfh_cmd_done(privdata->version, cmd, rc, retries,
+			       ktime_to_ns(latency));
+	if (rc)
+		pci_err(privdata->pci_dev, "Command 0x%08x not acknowledged\n",
+			cmd.ul);
+
+	return rc;
+}
+
 /**
  * amd_sfh_start_sensor - Starts the respective sensor.
  * @pci_dev:	Sensor Fusion Hub PCI device
  * @sensor_idx:	Sensor index
  * @dma_handle:	DMA handle
+ * @interval:	Update interval in milliseconds
+ *
+ * Starting an already running sensor updates its interval.
+ *
+ * Returns 0 on success or < zero on errors.
  */
-void amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
-			  dma_addr_t dma_handle)
+int amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
+			 dma_addr_t dma_handle, u32 interval)
 {
 	struct amd_sfh_data *privdata;
 	union amd_sfh_parm parm;
@@ -99,7 +293,8 @@ void amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
 	switch (privdata->version) {
 	case AMD_SFH_HWID_V2:
 		cmd.cmd_v2.cmd_id = AMD_SFH_CMD_ENABLE_SENSOR;
-		cmd.cmd_v2.interval = AMD_SFH_UPDATE_INTERVAL;
+		cmd.cmd_v2.intr_enable = !!privdata->irq;
+		cmd.cmd_v2.interval = interval;
 		cmd.cmd_v2.sensor_id = sensor_idx;
 		cmd.cmd_v2.length = 16;
 
@@ -109,7 +304,7 @@ void amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
 		break;
 	default:
 		cmd.cmd_v1.cmd_id = AMD_SFH_CMD_ENABLE_SENSOR;
-		cmd.cmd_v1.interval = AMD_SFH_UPDATE_INTERVAL;
+		cmd.cmd_v1.interval = interval;
 		cmd.cmd_v1.sensor_id = sensor_idx;
 		break;
 	}
@@ -118,17 +313,19 @@ void amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
 	parm.s.buffer_layout = 1;
 	parm.s.buffer_length = 16;
 
-	writeq(dma_handle, privdata->mmio + AMD_C2P_MSG2);
-	writel(parm.ul, privdata->mmio + AMD_C2P_MSG1);
-	writel(cmd.ul, privdata->mmio + AMD_C2P_MSG0);
+	return amd_sfh_send_cmd(privdata, cmd, parm, dma_handle,
+				privdata->version == AMD_SFH_HWID_V2);
 }
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_start_sensor);
 
 /**
  * amd_sfh_stop_sensor - Stops the respective sensor.
  * @pci_dev:	Sensor Fusion Hub PCI device
  * @sensor_idx:	Sensors index
+ *
+ * Returns 0 on success or < zero on errors.
  */
-void amd_sfh_stop_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx)
+int amd_sfh_stop_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx)
 {
 	struct amd_sfh_data *privdata;
 	union amd_sfh_parm parm;
@@ -154,10 +351,10 @@ void amd_sfh_stop_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx)
 
 	parm.ul = 0;
 
-	writeq(0x0, privdata->mmio + AMD_C2P_MSG2);
-	writel(parm.ul, privdata->mmio + AMD_C2P_MSG1);
-	writel(cmd.ul, privdata->mmio + AMD_C2P_MSG0);
+	return amd_sfh_send_cmd(privdata, cmd, parm, 0,
+				privdata->version == AMD_SFH_HWID_V2);
 }
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_stop_sensor);
 
 static void amd_sfh_stop_all_sensors(struct amd_sfh_data *privdata)
 {
@@ -181,14 +378,129 @@ static void amd_sfh_stop_all_sensors(struct amd_sfh_data *privdata)
 
 	parm.ul = 0;
 
-	writel(parm.ul, privdata->mmio + AMD_C2P_MSG1);
-	writel(cmd.ul, privdata->mmio + AMD_C2P_MSG0);
+	amd_sfh_send_cmd(privdata, cmd, parm, 0, false);
+}
+
+/**
+ * amd_sfh_irq_handler - Acknowledges interrupts of the SFH.
+ * @irq:	Interrupt line
+ * @data:	SFH driver data
+ *
+ * Latches and clears the interrupt status and defers
+ * the report delivery to amd_sfh_irq_thread().
+ */
+AMD_SFH_VISIBLE_IF_KUNIT irqreturn_t amd_sfh_irq_handler(int irq, void *data)
+{
+	struct amd_sfh_data *privdata = data;
+	u32 status;
+
+	status = readl(privdata->mmio + AMD_P2C_MSG_INTSTS);
+	if (!status)
+		return IRQ_NONE;
+
+	writel(0, privdata->mmio + AMD_P2C_MSG_INTSTS);
+	WRITE_ONCE(privdata->irq_time, ktime_get());
+	WRITE_ONCE(privdata->irq_seen, privdata->irq_seen | status);
+	atomic_or(status, &privdata->irq_status);
+	return IRQ_WAKE_THREAD;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_irq_handler);
+
+/**
+ * amd_sfh_irq_thread - Delivers reports of sensors with new data.
+ * @irq:	Interrupt line
+ * @data:	SFH driver data
+ *
+ * The interrupt status is assumed to hold one bit per sensor index
+ * that signals new data in the sensor's DRAM buffer. This layout has
+ * not been confirmed, which is why interrupts are only used on request.
+ * The bits seen so far are exposed in debugfs to verify it.
+ */
+AMD_SFH_VISIBLE_IF_KUNIT irqreturn_t amd_sfh_irq_thread(int irq, void *data)
+{
+	struct amd_sfh_data *privdata = data;
+
+	amd_sfh_client_report(privdata, atomic_xchg(&privdata->irq_status, 0),
+			      READ_ONCE(privdata->irq_time));
+	return IRQ_HANDLED;
 }
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_irq_thread);
 
-static void amd_sfh_pci_remove(void *privdata)
+/**
+ * amd_sfh_irq_init - Sets up interrupt driven report delivery.
+ * @privdata:	SFH driver data
+ *
+ * Returns 0 on success and non-zero on errors.
+ */
+static int amd_sfh_irq_init(struct amd_sfh_data *privdata)
 {
+	struct pci_dev *pci_dev = privdata->pci_dev;
+	int irq, rc;
+
+	rc = pci_alloc_irq_vectors(pci_dev, 1, 1, PCI_IRQ_ALL_TYPES);
+	if (rc < 0)
+		return rc;
+
+	irq = pci_irq_vector(pci_dev, 0);
+	rc = devm_request_threaded_irq(&pci_dev->dev, irq, amd_sfh_irq_handler,
+				       amd_sfh_irq_thread, IRQF_SHARED,
+				       DRIVER_NAME, privdata);
+	if (rc) {
+		pci_free_irq_vectors(pci_dev);
+		return rc;
+	}
+
+	privdata->irq = irq;
+	return 0;
+}
+
+/**
+ * amd_sfh_irq_enable - Enables interrupt generation on the SFH.
+ * @privdata:	SFH driver data
+ */
+static void amd_sfh_irq_enable(struct amd_sfh_data *privdata)
+{
+	if (!privdata->irq)
+		return;
+
+	writel(0, privdata->mmio + AMD_P2C_MSG_INTSTS);
+	writel(AMD_SFH_IRQ_ENABLE, privdata->mmio + AMD_P2C_MSG_INTEN);
+}
+
+/**
+ * amd_sfh_irq_disable - Disables interrupt generation on the SFH.
+ * @privdata:	SFH driver data
+ *
+ * Waits for running interrupt handlers to complete.
+ */
+static void amd_sfh_irq_disable(struct amd_sfh_data *privdata)
+{
+	if (!privdata->irq)
+		return;
+
+	writel(0, privdata->mmio + AMD_P2C_MSG_INTEN);
+	synchronize_irq(privdata->irq);
+}
+
+/**
+ * amd_sfh_pci_deinit - Tears down the SFH.
+ * @data:	SFH driver data
+ *
+ * Runs as devres action on removal and on probe errors.
+ * It does not touch runtime PM, which is only armed once
+ * the probe cannot fail anymore and disarmed by amd_sfh_pci_remove().
+ */
+static void amd_sfh_pci_deinit(void *data)
+{
+	struct amd_sfh_data *privdata = data;
+
+	amd_sfh_irq_disable(privdata);
+	amd_sfh_cdev_deinit(privdata);
 	amd_sfh_client_deinit(privdata);
+	amd_sfh_sched_deinit(privdata);
 	amd_sfh_stop_all_sensors(privdata);
+	amd_sfh_debugfs_deinit(privdata);
+	mutex_destroy(&privdata->cmd_lock);
 }
 
 static int amd_sfh_pci_probe(struct pci_dev *pci_dev,
@@ -219,12 +531,140 @@ static int amd_sfh_pci_probe(struct pci_dev *pci_dev,
 	if (rc)
 		return rc;
 
+	privdata->dma_cpu_addr = dmam_alloc_coherent(&pci_dev->dev,
+						     AMD_SFH_DMA_SIZE,
+						     &privdata->dma_handle,
+						     GFP_KERNEL);
+	if (!privdata->dma_cpu_addr)
+		return -ENOMEM;
+
 	privdata->version = amd_sfh_get_version(privdata->mmio);
+	mutex_init(&privdata->cmd_lock);
+
+	/*
+	 * Firmware prior to V2 cannot signal new data, so keep polling it.
+	 * The per-sensor interrupt status bits of V2 firmware have not been
+	 * confirmed on all devices, so they are only used on request.
+	 */
+	if (use_interrupts && privdata->version == AMD_SFH_HWID_V2) {
+		rc = amd_sfh_irq_init(privdata);
+		if (rc)
+			pci_warn(pci_dev, "Falling back to polling: %d\n", rc);
+	}
+
+	rc = amd_sfh_sched_init(privdata);
+	if (rc)
+		return rc;
+
+	amd_sfh_debugfs_init(privdata);
 	amd_sfh_client_init(privdata);
-	return devm_add_action_or_reset(&pci_dev->dev, amd_sfh_pci_remove,
-					privdata);
+	amd_sfh_cdev_init(privdata);
+	amd_sfh_irq_enable(privdata);
+	rc = devm_add_action_or_reset(&pci_dev->dev, amd_sfh_pci_deinit,
+				      privdata);
+	if (rc)
+		return rc;
+
+	/* Drop the reference the PCI core holds during the probe */
+	pm_runtime_set_autosuspend_delay(&pci_dev->dev,
+					 AMD_SFH_AUTOSUSPEND_DELAY);
+	pm_runtime_use_autosuspend(&pci_dev->dev);
+	pm_runtime_allow(&pci_dev->dev);
+	pm_runtime_mark_last_busy(&pci_dev->dev);
+	pm_runtime_put_autosuspend(&pci_dev->dev);
+	return 0;
 }
 
+/**
+ * amd_sfh_pci_remove - Disarms runtime PM of the SFH.
+ * @pci_dev:	Sensor Fusion Hub PCI device
+ *
+ * Runs before the PCI core drops its reference of the probe and before
+ * amd_sfh_pci_deinit(), so that the SFH is torn down while resumed.
+ * Retakes the reference dropped by the probe and forbids runtime PM,
+ * balancing pm_runtime_put_autosuspend() and pm_runtime_allow().
+ */
+static void amd_sfh_pci_remove(struct pci_dev *pci_dev)
+{
+	pm_runtime_get_noresume(&pci_dev->dev);
+	pm_runtime_forbid(&pci_dev->dev);
+	pm_runtime_dont_use_autosuspend(&pci_dev->dev);
+}
+
+/**
+ * amd_sfh_suspend - Stops all sensors for system sleep.
+ * @dev:	SFH device
+ *
+ * Resumes a runtime suspended SFH first, since stopping
+ * the sensors writes to the mailbox.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int __maybe_unused amd_sfh_suspend(struct device *dev)
+{
+	struct amd_sfh_data *privdata = dev_get_drvdata(dev);
+	int rc;
+
+	rc = pm_runtime_resume(dev);
+	if (rc < 0)
+		return rc;
+
+	amd_sfh_client_suspend(privdata);
+	amd_sfh_stop_all_sensors(privdata);
+	amd_sfh_irq_disable(privdata);
+	return 0;
+}
+
+/**
+ * amd_sfh_resume - Restarts the sensors that were open on suspend.
+ * @dev:	SFH device
+ *
+ * Lets the SFH autosuspend again if no sensor is open,
+ * since amd_sfh_suspend() resumed it.
+ *
+ * Returns 0.
+ */
+static int __maybe_unused amd_sfh_resume(struct device *dev)
+{
+	struct amd_sfh_data *privdata = dev_get_drvdata(dev);
+
+	amd_sfh_irq_enable(privdata);
+	amd_sfh_client_resume(privdata);
+	pm_runtime_mark_last_busy(dev);
+	pm_request_autosuspend(dev);
+	return 0;
+}
+
+/**
+ * amd_sfh_runtime_suspend - Idles the SFH once all sensors are closed.
+ * @dev:	SFH device
+ *
+ * Returns 0.
+ */
+static int __maybe_unused amd_sfh_runtime_suspend(struct device *dev)
+{
+	amd_sfh_irq_disable(dev_get_drvdata(dev));
+	return 0;
+}
+
+/**
+ * amd_sfh_runtime_resume - Wakes up the SFH before a sensor is opened.
+ * @dev:	SFH device
+ *
+ * Returns 0.
+ */
+static int __maybe_unused amd_sfh_runtime_resume(struct device *dev)
+{
+	amd_sfh_irq_enable(dev_get_drvdata(dev));
+	return 0;
+}
+
+static const struct dev_pm_ops amd_sfh_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(amd_sfh_suspend, amd_sfh_resume)
+	SET_RUNTIME_PM_OPS(amd_sfh_runtime_suspend, amd_sfh_runtime_resume,
+			   NULL)
+};
+
 static const struct pci_device_id amd_sfh_pci_tbl[] = {
 	{ PCI_VDEVICE(AMD, PCI_DEVICE_ID_AMD_SFH) },
 	{ }
@@ -235,6 +675,9 @@ static struct pci_driver amd_sfh_pci_driver = {
 	.name		= "amd-sfh-pci",
 	.id_table	= amd_sfh_pci_tbl,
 	.probe		= amd_sfh_pci_probe,
+	.remove		= amd_sfh_pci_remove,
+	.driver.pm	= &amd_sfh_pm_ops,
+	.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 };
 module_pci_driver(amd_sfh_pci_driver);
 
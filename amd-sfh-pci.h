@@ -9,13 +9,34 @@
 #ifndef AMD_SFH_PCI_H
 #define AMD_SFH_PCI_H
 
+#include <linux/cache.h>
+#include <linux/irqreturn.h>
+#include <linux/kernel.h>
 #include <linux/pci.h>
 #include <linux/types.h>
 
 #include "amd-sfh.h"
 
 #define AMD_SFH_UPDATE_INTERVAL		200
+#define AMD_SFH_MIN_INTERVAL		1
 #define AMD_SFH_HWID_V2			0x2
+#define AMD_SFH_IRQ_ENABLE		BIT(0)
+#define AMD_SFH_AUTOSUSPEND_DELAY	2000
+
+/* Mailbox command acknowledgement */
+#define AMD_SFH_CMD_POLL_US		500
+#define AMD_SFH_CMD_TIMEOUT_US		1600000
+#define AMD_SFH_CMD_RETRIES		2
+
+/* DMA memory is carved into cache-line-aligned slots of each sensor */
+#define AMD_SFH_DMA_SAMPLE_SIZE		(sizeof(int) * 8)
+#define AMD_SFH_DMA_SLOT_SIZE		ALIGN(AMD_SFH_DMA_SAMPLE_SIZE, \
+					      L1_CACHE_BYTES)
+#define AMD_SFH_DMA_SLOTS		4
+#define AMD_SFH_DMA_SENSOR_SIZE		(AMD_SFH_DMA_SLOT_SIZE * \
+					 AMD_SFH_DMA_SLOTS)
+#define AMD_SFH_DMA_SIZE		(AMD_SFH_DMA_SENSOR_SIZE * \
+					 AMD_SFH_MAX_SENSORS)
 
 enum amd_sfh_mem_use_type {
 	AMD_SFH_USE_DRAM,
@@ -39,7 +60,7 @@ enum amd_sfh_pci_registers {
 	AMD_C2P_MSG9 = 0x10524,		/* Data 7 */
 
 	/* SFH P2C Message Registers */
-	AMD_P2C_MSG0 = 0x10680,		/* Do not use */
+	AMD_P2C_MSG0 = 0x10680,		/* SFH command response (V2) */
 	AMD_P2C_MSG1 = 0x10684,		/* I2C0 interrupt register */
 	AMD_P2C_MSG2 = 0x10688,		/* I2C1 interrupt register */
 	AMD_P2C_MSG3 = 0x1068C,		/* SFH sensor info */
@@ -96,10 +117,46 @@ union amd_sfh_parm {
 	} s;
 };
 
+/**
+ * SFH command responses
+ */
+enum amd_sfh_response {
+	AMD_SFH_RESP_SENSOR_ENABLED = 4,
+	AMD_SFH_RESP_SENSOR_DISABLED,
+};
+
+/**
+ * SFH command response register
+ */
+union amd_sfh_cmd_response {
+	u32 ul;
+	struct {
+		u32 status : 2;
+		u32 out_in_c2p : 1;
+		u32 rsvd1 : 1;
+		u32 response : 4;
+		u32 sub_cmd : 8;
+		u32 sensor_id : 6;
+		u32 rsvd2 : 10;
+	} s;
+};
+
+struct amd_sfh_quirks;
+
+uint amd_sfh_select_sensor_mask(uint sensor_mask, uint override,
+				const struct amd_sfh_quirks *quirks);
 uint amd_sfh_get_sensor_mask(struct pci_dev *pci_dev);
+u32 *amd_sfh_get_dma_slots(struct pci_dev *pci_dev, dma_addr_t *dma_handle);
+void amd_sfh_put_dma_slots(struct pci_dev *pci_dev, u32 *cpu_addr);
 int amd_sfh_get_illuminance(struct pci_dev *pci_dev);
-void amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
-			  dma_addr_t dma_handle);
-void amd_sfh_stop_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx);
+u32 amd_sfh_get_max_interval(struct pci_dev *pci_dev);
+int amd_sfh_start_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx,
+			 dma_addr_t dma_handle, u32 interval);
+int amd_sfh_stop_sensor(struct pci_dev *pci_dev, enum sensor_idx sensor_idx);
+
+#if IS_ENABLED(CONFIG_AMD_SFH_KUNIT_TEST)
+irqreturn_t amd_sfh_irq_handler(int irq, void *data);
+irqreturn_t amd_sfh_irq_thread(int irq, void *data);
+#endif
 
 #endif
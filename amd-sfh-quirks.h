@@ -14,9 +14,11 @@
 /**
  * Quirks settings.
  * @sensor_mask:	Sensor mask override
+ * @tablet_mode:	Whether the lid switch also closes in tablet mode
  */
 struct amd_sfh_quirks {
 	uint sensor_mask;
+	bool tablet_mode;
 };
 
 struct amd_sfh_quirks *amd_sfh_get_quirks(void);
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub sensor scheduler
+ *
+ * Polls all sensors of a Sensor Fusion Hub from a single high-priority
+ * kthread worker, which is woken up by a high-resolution timer.
+ * Each sensor keeps its own deadline, so that sensors may run at
+ * different rates, while all sensors that are due within the same
+ * wakeup are read together.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/pci.h>
+#include <linux/sched.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-sched.h"
+#include "amd-sfh-trace.h"
+
+/**
+ * sched_interval - Returns the polling interval of a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * Returns the sensor's own polling interval or, if it has none,
+ * the configured report interval as ktime.
+ */
+static ktime_t sched_interval(struct amd_sfh_hid_data *hid_data)
+{
+	if (hid_data->poll_interval)
+		return ms_to_ktime(hid_data->poll_interval);
+
+	return ms_to_ktime(READ_ONCE(hid_data->settings.report_interval));
+}
+
+/**
+ * sched_due - Checks whether a sensor is due for polling.
+ * @hid_data:	HID device driver data
+ * @now:	Current time
+ *
+ * Sensors which would become due within an eighth of their
+ * interval are considered due, so that they can be read
+ * along with the other sensors of the current wakeup.
+ */
+static bool sched_due(struct amd_sfh_hid_data *hid_data, ktime_t now)
+{
+	ktime_t slack = sched_interval(hid_data) >> 3;
+
+	return ktime_compare(ktime_add(now, slack), hid_data->deadline) >= 0;
+}
+
+/**
+ * sched_rearm - Schedules the next wakeup of the scheduler.
+ * @privdata:	SFH driver data
+ *
+ * Arms the timer for the earliest deadline of all polled sensors.
+ * The caller must hold the scheduler lock.
+ */
+static void sched_rearm(struct amd_sfh_data *privdata)
+{
+	struct amd_sfh_hid_data *hid_data;
+	ktime_t next = KTIME_MAX;
+
+	if (list_empty(&privdata->sched_list)) {
+		hrtimer_try_to_cancel(&privdata->sched_timer);
+		return;
+	}
+
+	list_for_each_entry(hid_data, &privdata->sched_list, sched_node)
+		next = min(next, hid_data->deadline);
+
+	hrtimer_start(&privdata->sched_timer, next, HRTIMER_MODE_ABS);
+}
+
+/**
+ * sched_poll - Polls all due sensors.
+ * @work:	Kthread work
+ *
+ * Delivers the input reports of all due sensors in one go
+ * and advances their deadlines by their respective interval.
+ */
+static void sched_poll(struct kthread_work *work)
+{
+	struct amd_sfh_data *privdata;
+	struct amd_sfh_hid_data *hid_data;
+	ktime_t expires, now = ktime_get();
+	unsigned int polled = 0;
+
+	privdata = container_of(work, struct amd_sfh_data, sched_work);
+	expires = hrtimer_get_expires(&privdata->sched_timer);
+
+	mutex_lock(&privdata->sched_lock);
+	list_for_each_entry(hid_data, &privdata->sched_list, sched_node) {
+		if (!sched_due(hid_data, now))
+			continue;
+
+		amd_sfh_hid_ll_report(hid_data, hid_data->deadline);
+		polled++;
+
+		/* Keep the cadence unless a whole interval was missed */
+		hid_data->deadline = ktime_add(hid_data->deadline,
+					       sched_interval(hid_data));
+		if (ktime_compare(hid_data->deadline, now) <= 0) {
+			hid_data->deadline = ktime_add(now,
+						       sched_interval(hid_data));
+			hid_data->stats.missed++;
+		}
+	}
+
+	trace_amd_sfh_poll(polled, ktime_to_ns(ktime_sub(now, expires)));
+	sched_rearm(privdata);
+	mutex_unlock(&privdata->sched_lock);
+}
+
+/**
+ * sched_wakeup - Wakes up the scheduler's worker.
+ * @timer:	High-resolution timer
+ *
+ * Polling is deferred to the worker, since reading the
+ * sensors and delivering reports may sleep.
+ */
+static enum hrtimer_restart sched_wakeup(struct hrtimer *timer)
+{
+	struct amd_sfh_data *privdata;
+
+	privdata = container_of(timer, struct amd_sfh_data, sched_timer);
+	kthread_queue_work(privdata->sched_worker, &privdata->sched_work);
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * amd_sfh_sched_init - Initializes the sensor scheduler.
+ * @privdata:	SFH driver data
+ *
+ * Creates a worker with real-time priority, so that the sensors
+ * are polled with low jitter regardless of the system's load.
+ *
+ * Returns 0 on success and non-zero on errors.
+ */
+int amd_sfh_sched_init(struct amd_sfh_data *privdata)
+{
+	struct kthread_worker *worker;
+
+	worker = kthread_create_worker(0, "amd-sfh-%s",
+				       pci_name(privdata->pci_dev));
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+
+	sched_set_fifo_low(worker->task);
+	privdata->sched_worker = worker;
+	kthread_init_work(&privdata->sched_work, sched_poll);
+	hrtimer_init(&privdata->sched_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	privdata->sched_timer.function = sched_wakeup;
+	INIT_LIST_HEAD(&privdata->sched_list);
+	mutex_init(&privdata->sched_lock);
+	return 0;
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_sched_init);
+
+/**
+ * amd_sfh_sched_deinit - Stops the sensor scheduler.
+ * @privdata:	SFH driver data
+ */
+void amd_sfh_sched_deinit(struct amd_sfh_data *privdata)
+{
+	hrtimer_cancel(&privdata->sched_timer);
+	kthread_cancel_work_sync(&privdata->sched_work);
+	kthread_destroy_worker(privdata->sched_worker);
+	mutex_destroy(&privdata->sched_lock);
+}
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_sched_deinit);
+
+/**
+ * amd_sfh_sched_add - Starts polling a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * The first deadline of the sensor is aligned to the next
+ * wakeup of the scheduler if that is due within the sensor's
+ * interval, so that sensors opened at different times are
+ * nevertheless read together.
+ */
+void amd_sfh_sched_add(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+	struct amd_sfh_hid_data *other;
+	ktime_t now = ktime_get();
+
+	mutex_lock(&privdata->sched_lock);
+	hid_data->deadline = ktime_add(now, sched_interval(hid_data));
+	list_for_each_entry(other, &privdata->sched_list, sched_node) {
+		if (ktime_after(other->deadline, now) &&
+		    ktime_before(other->deadline, hid_data->deadline))
+			hid_data->deadline = other->deadline;
+	}
+
+	list_add_tail(&hid_data->sched_node, &privdata->sched_list);
+	sched_rearm(privdata);
+	mutex_unlock(&privdata->sched_lock);
+}
+
+/**
+ * amd_sfh_sched_remove - Stops polling a sensor.
+ * @hid_data:	HID device driver data
+ *
+ * After this function returns, the scheduler will
+ * no longer deliver reports of the respective sensor.
+ */
+void amd_sfh_sched_remove(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+
+	mutex_lock(&privdata->sched_lock);
+	list_del_init(&hid_data->sched_node);
+	sched_rearm(privdata);
+	mutex_unlock(&privdata->sched_lock);
+}
+
+/**
+ * amd_sfh_sched_update - Applies a changed interval of a sensor.
+ * @hid_data:	HID device driver data
+ */
+void amd_sfh_sched_update(struct amd_sfh_hid_data *hid_data)
+{
+	struct amd_sfh_data *privdata = pci_get_drvdata(hid_data->pci_dev);
+
+	mutex_lock(&privdata->sched_lock);
+	hid_data->deadline = ktime_add(ktime_get(), sched_interval(hid_data));
+	sched_rearm(privdata);
+	mutex_unlock(&privdata->sched_lock);
+}
+
+/**
+ * amd_sfh_sched_sync - Waits for a running poll to complete.
+ * @privdata:	SFH driver data
+ *
+ * The scheduler polls all sensors with its lock held,
+ * so acquiring the lock waits for the current poll.
+ */
+void amd_sfh_sched_sync(struct amd_sfh_data *privdata)
+{
+	mutex_lock(&privdata->sched_lock);
+	mutex_unlock(&privdata->sched_lock);
+}
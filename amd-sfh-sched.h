@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub sensor scheduler interface
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_SCHED_H
+#define AMD_SFH_SCHED_H
+
+#include "amd-sfh.h"
+#include "amd-sfh-hid-ll-drv.h"
+
+int amd_sfh_sched_init(struct amd_sfh_data *privdata);
+void amd_sfh_sched_deinit(struct amd_sfh_data *privdata);
+void amd_sfh_sched_add(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_sched_remove(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_sched_update(struct amd_sfh_hid_data *hid_data);
+void amd_sfh_sched_sync(struct amd_sfh_data *privdata);
+
+#endif
@@ -0,0 +1,723 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub KUnit tests
+ *
+ * Runs the mailbox, the sensor reference counting and the interrupt
+ * handling against a fake MP2, whose registers and DMA memory are plain
+ * memory. A kthread plays the firmware's part of the mailbox protocol:
+ * it acknowledges or drops the commands and, for every enabled sensor,
+ * fills its DMA buffer and raises its bit of the interrupt status.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <kunit/test.h>
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/io-64-nonatomic-lo-hi.h>
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pci.h>
+#include <linux/pm_runtime.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-debugfs.h"
+#include "amd-sfh-hid-ll-drv.h"
+#include "amd-sfh-pci.h"
+#include "amd-sfh-quirks.h"
+#include "amd-sfh-sched.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define AMD_SFH_TEST_MMIO_SIZE	(AMD_P2C_MSG_INTSTS + sizeof(u32))
+#define AMD_SFH_TEST_DMA_HANDLE	0x1000
+#define AMD_SFH_TEST_HWID_V1	0x1
+#define AMD_SFH_TEST_IRQ	INT_MAX
+#define AMD_SFH_TEST_LUX	300
+#define AMD_SFH_TEST_RACERS	4
+#define AMD_SFH_TEST_ROUNDS	50
+
+/* Older kernels do not mark slow test cases */
+#ifndef KUNIT_CASE_SLOW
+#define KUNIT_CASE_SLOW(test_name)	KUNIT_CASE(test_name)
+#endif
+
+/**
+ * struct amd_sfh_test_sensor - Physical sensor and its expected sample.
+ * @ops:	Sensor type
+ * @count:	Amount of values of the sample
+ * @values:	Values read from the buffer filled by fake_mp2_fill()
+ * @scaled:	Bitmask of the values, which keep the firmware's
+ *		precision in high precision mode
+ */
+struct amd_sfh_test_sensor {
+	const struct amd_sfh_sensor_ops *ops;
+	u8 count;
+	int values[AMD_SFH_MAX_AXES];
+	unsigned long scaled;
+};
+
+static const struct amd_sfh_test_sensor amd_sfh_test_sensors[] = {
+	{ &amd_sfh_accel_ops, 4, { 1, 2, 3, 4 }, GENMASK(2, 0) },
+	{ &amd_sfh_gyro_ops, 3, { 2, 4, 6 }, GENMASK(2, 0) },
+	{ &amd_sfh_mag_ops, 4, { 3, 6, 9, 12 }, GENMASK(2, 0) },
+	{ &amd_sfh_lid_ops, 1, { 1 }, 0 },
+	{ &amd_sfh_als_ops, 1, { AMD_SFH_TEST_LUX }, BIT(0) },
+};
+
+/**
+ * struct amd_sfh_test - Per test case state.
+ * @privdata:	SFH driver data of the fake MP2
+ * @hid_data:	HID device driver data of the tested sensors
+ * @pci_dev:	Fake SFH PCI device
+ * @mp2:	Thread acknowledging commands or NULL if the MP2 is silent
+ * @drop:	Amount of commands the MP2 drops before acknowledging
+ * @received:	Amount of commands the MP2 received
+ * @sensors:	Amount of initialized entries of @hid_data
+ */
+struct amd_sfh_test {
+	struct amd_sfh_data privdata;
+	struct amd_sfh_hid_data hid_data[AMD_SFH_MAX_SENSORS];
+	struct pci_dev *pci_dev;
+	struct task_struct *mp2;
+	atomic_t drop;
+	atomic_t received;
+	int sensors;
+};
+
+/**
+ * struct amd_sfh_test_racer - Thread racing for a sensor.
+ * @work:	Work item running the thread on an unbound worker
+ * @hid_data:	HID device driver data of the sensor
+ * @own:	Whether to open the sensor's own device or to get the sensor
+ * @errors:	Amount of failed opens or gets
+ */
+struct amd_sfh_test_racer {
+	struct work_struct work;
+	struct amd_sfh_hid_data *hid_data;
+	bool own;
+	int errors;
+};
+
+/**
+ * fake_mp2_value - Returns the value the fake MP2 writes for a sensor.
+ * @sensor_id:	Sensor index
+ * @axis:	Axis of the sample
+ */
+static u32 fake_mp2_value(u8 sensor_id, int axis)
+{
+	return (sensor_id + 1) * (axis + 1) * AMD_SFH_FW_MUL;
+}
+
+/**
+ * fake_mp2_fill - Provides the first sample of an enabled sensor.
+ * @ctx:	Test state
+ * @sensor_id:	Sensor index
+ *
+ * Writes the sample to the DMA buffer the command pointed to and,
+ * for the V2 ambient light sensor, the illuminance to its register.
+ * Then signals the new data in the interrupt status.
+ */
+static void fake_mp2_fill(struct amd_sfh_test *ctx, u8 sensor_id)
+{
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	void __iomem *mmio = privdata->mmio;
+	dma_addr_t dma_handle = readq(mmio + AMD_C2P_MSG2);
+	u32 *slot;
+	int i;
+
+	if (dma_handle < privdata->dma_handle ||
+	    dma_handle >= privdata->dma_handle + AMD_SFH_DMA_SIZE)
+		return;
+
+	slot = privdata->dma_cpu_addr + (dma_handle - privdata->dma_handle);
+	for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+		WRITE_ONCE(slot[i], fake_mp2_value(sensor_id, i));
+
+	if (privdata->version == AMD_SFH_HWID_V2 && sensor_id == ALS_IDX)
+		writel(AMD_SFH_TEST_LUX, mmio + AMD_C2P_MSG5);
+
+	writel(readl(mmio + AMD_P2C_MSG_INTSTS) | BIT(sensor_id),
+	       mmio + AMD_P2C_MSG_INTSTS);
+}
+
+/**
+ * fake_mp2_respond - Processes a command as the firmware does.
+ * @ctx:	Test state
+ * @cmd:	Received command
+ *
+ * Only V2 firmware acknowledges commands.
+ */
+static void fake_mp2_respond(struct amd_sfh_test *ctx, union amd_sfh_cmd cmd)
+{
+	union amd_sfh_cmd_response resp;
+	u8 cmd_id, sensor_id;
+
+	if (ctx->privdata.version != AMD_SFH_HWID_V2) {
+		if (cmd.cmd_v1.cmd_id == AMD_SFH_CMD_ENABLE_SENSOR)
+			fake_mp2_fill(ctx, cmd.cmd_v1.sensor_id);
+
+		return;
+	}
+
+	cmd_id = cmd.cmd_v2.cmd_id;
+	sensor_id = cmd.cmd_v2.sensor_id;
+	if (cmd_id == AMD_SFH_CMD_ENABLE_SENSOR)
+		fake_mp2_fill(ctx, sensor_id);
+
+	resp.ul = 0;
+	resp.s.sensor_id = sensor_id;
+	if (cmd_id == AMD_SFH_CMD_ENABLE_SENSOR)
+		resp.s.response = AMD_SFH_RESP_SENSOR_ENABLED;
+	else
+		resp.s.response = AMD_SFH_RESP_SENSOR_DISABLED;
+
+	writel(resp.ul, ctx->privdata.mmio + AMD_P2C_MSG0);
+}
+
+/**
+ * fake_mp2_run - Processes the commands sent to the fake MP2.
+ * @data:	Test state
+ *
+ * Consumes the command register like the firmware does,
+ * so that resent commands are received again.
+ */
+static int fake_mp2_run(void *data)
+{
+	struct amd_sfh_test *ctx = data;
+	void __iomem *mmio = ctx->privdata.mmio;
+	union amd_sfh_cmd cmd;
+
+	while (!kthread_should_stop()) {
+		cmd.ul = readl(mmio + AMD_C2P_MSG0);
+		if (cmd.ul) {
+			writel(0, mmio + AMD_C2P_MSG0);
+			atomic_inc(&ctx->received);
+			if (atomic_dec_if_positive(&ctx->drop) < 0)
+				fake_mp2_respond(ctx, cmd);
+		}
+
+		usleep_range(AMD_SFH_CMD_POLL_US / 4, AMD_SFH_CMD_POLL_US / 2);
+	}
+
+	return 0;
+}
+
+/**
+ * amd_sfh_test_start_mp2 - Lets the fake MP2 acknowledge commands.
+ * @test:	Test case
+ * @drop:	Amount of commands to drop before acknowledging
+ */
+static void amd_sfh_test_start_mp2(struct kunit *test, int drop)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct task_struct *mp2;
+
+	atomic_set(&ctx->drop, drop);
+	mp2 = kthread_run(fake_mp2_run, ctx, "amd-sfh-test-mp2");
+	KUNIT_ASSERT_FALSE(test, IS_ERR(mp2));
+	ctx->mp2 = mp2;
+}
+
+/**
+ * amd_sfh_test_add_sensor - Sets up a sensor of the fake MP2.
+ * @test:	Test case
+ * @ops:	Sensor type
+ * @version:	SFH hardware version
+ *
+ * Initializes the HID device driver data like the client does.
+ * The longest interval keeps the scheduler from polling the sensor,
+ * since no HID device receives its reports.
+ */
+static struct amd_sfh_hid_data *
+amd_sfh_test_add_sensor(struct kunit *test,
+			const struct amd_sfh_sensor_ops *ops, u8 version)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_hid_data *hid_data;
+
+	KUNIT_ASSERT_LT(test, ctx->sensors, AMD_SFH_MAX_SENSORS);
+	hid_data = &ctx->hid_data[ctx->sensors];
+	ctx->privdata.version = version;
+	hid_data->pci_dev = ctx->pci_dev;
+	hid_data->version = version;
+	hid_data->sensor_idx = ops->sensor_idx;
+	hid_data->ops = ops;
+	INIT_LIST_HEAD(&hid_data->sched_node);
+	INIT_KFIFO(hid_data->fifo);
+	mutex_init(&hid_data->lock);
+	mutex_init(&hid_data->fifo_lock);
+	hid_data->settings.report_interval =
+		amd_sfh_get_max_interval(ctx->pci_dev);
+	hid_data->settings.report_state = AMD_SFH_REPORT_STATE;
+	hid_data->cpu_addr = amd_sfh_get_dma_slots(ctx->pci_dev,
+						   &hid_data->dma_handle);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, hid_data->cpu_addr);
+	amd_sfh_hid_ll_init(hid_data);
+	ctx->privdata.sensors[ctx->sensors++] = hid_data;
+	return hid_data;
+}
+
+/**
+ * amd_sfh_test_get_all - Starts all physical sensors of the fake MP2.
+ * @test:	Test case
+ *
+ * Reports are delivered by interrupts, which the test case raises
+ * by calling the handlers. The line does not exist, so that
+ * synchronizing with it returns at once.
+ *
+ * Returns the bitmask of the started sensors.
+ */
+static uint amd_sfh_test_get_all(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_hid_data *hid_data;
+	uint sensor_mask = 0;
+	int i;
+
+	ctx->privdata.irq = AMD_SFH_TEST_IRQ;
+	amd_sfh_test_start_mp2(test, 0);
+	for (i = 0; i < ARRAY_SIZE(amd_sfh_test_sensors); i++) {
+		hid_data = amd_sfh_test_add_sensor(test,
+						   amd_sfh_test_sensors[i].ops,
+						   AMD_SFH_HWID_V2);
+		KUNIT_ASSERT_EQ(test, amd_sfh_hid_ll_get(hid_data), 0);
+		sensor_mask |= BIT(hid_data->sensor_idx);
+	}
+
+	return sensor_mask;
+}
+
+/**
+ * amd_sfh_test_put_all - Stops all sensors started by the test case.
+ * @test:	Test case
+ */
+static void amd_sfh_test_put_all(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	int i;
+
+	for (i = 0; i < ctx->sensors; i++)
+		amd_sfh_hid_ll_put(&ctx->hid_data[i]);
+}
+
+/**
+ * amd_sfh_test_race - Opens and closes or gets and puts a sensor.
+ * @work:	Work item of the racer
+ */
+static void amd_sfh_test_race(struct work_struct *work)
+{
+	struct amd_sfh_test_racer *racer;
+	int i;
+
+	racer = container_of(work, struct amd_sfh_test_racer, work);
+	for (i = 0; i < AMD_SFH_TEST_ROUNDS; i++) {
+		if (racer->own) {
+			if (amd_sfh_hid_ll_open(racer->hid_data))
+				racer->errors++;
+			else
+				amd_sfh_hid_ll_close(racer->hid_data);
+		} else {
+			if (amd_sfh_hid_ll_get(racer->hid_data))
+				racer->errors++;
+			else
+				amd_sfh_hid_ll_put(racer->hid_data);
+		}
+
+		cond_resched();
+	}
+}
+
+/**
+ * amd_sfh_test_usage_count - Returns the runtime PM usage count of the SFH.
+ * @test:	Test case
+ */
+static int amd_sfh_test_usage_count(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+
+	return atomic_read(&ctx->pci_dev->dev.power.usage_count);
+}
+
+static void amd_sfh_test_release(struct device *dev)
+{
+	kfree(to_pci_dev(dev));
+}
+
+static int amd_sfh_test_init(struct kunit *test)
+{
+	struct amd_sfh_data *privdata;
+	struct amd_sfh_test *ctx;
+	struct pci_dev *pci_dev;
+	int rc;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	privdata = &ctx->privdata;
+	privdata->mmio = (void __iomem *)kunit_kzalloc(test,
+						       AMD_SFH_TEST_MMIO_SIZE,
+						       GFP_KERNEL);
+	privdata->dma_cpu_addr = kunit_kzalloc(test, AMD_SFH_DMA_SIZE,
+					       GFP_KERNEL);
+	if (!privdata->mmio || !privdata->dma_cpu_addr)
+		return -ENOMEM;
+
+	pci_dev = kzalloc(sizeof(*pci_dev), GFP_KERNEL);
+	if (!pci_dev)
+		return -ENOMEM;
+
+	device_initialize(&pci_dev->dev);
+	pci_dev->dev.release = amd_sfh_test_release;
+	rc = dev_set_name(&pci_dev->dev, "amd-sfh-test");
+	if (rc) {
+		put_device(&pci_dev->dev);
+		return rc;
+	}
+
+	privdata->pci_dev = pci_dev;
+	privdata->dma_handle = AMD_SFH_TEST_DMA_HANDLE;
+	pci_set_drvdata(pci_dev, privdata);
+	mutex_init(&privdata->cmd_lock);
+	rc = amd_sfh_sched_init(privdata);
+	if (rc) {
+		mutex_destroy(&privdata->cmd_lock);
+		put_device(&pci_dev->dev);
+		return rc;
+	}
+
+	amd_sfh_debugfs_init(privdata);
+	pm_runtime_no_callbacks(&pci_dev->dev);
+	pm_runtime_set_active(&pci_dev->dev);
+	pm_runtime_enable(&pci_dev->dev);
+	ctx->pci_dev = pci_dev;
+	test->priv = ctx;
+	return 0;
+}
+
+static void amd_sfh_test_exit(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_hid_data *hid_data;
+	struct amd_sfh_data *privdata;
+	int i;
+
+	/* The exit also runs if the initialization failed */
+	if (!ctx)
+		return;
+
+	privdata = &ctx->privdata;
+	if (ctx->mp2)
+		kthread_stop(ctx->mp2);
+
+	for (i = 0; i < ctx->sensors; i++) {
+		hid_data = &ctx->hid_data[i];
+		privdata->sensors[i] = NULL;
+		amd_sfh_hid_ll_deinit(hid_data);
+		amd_sfh_put_dma_slots(ctx->pci_dev, hid_data->cpu_addr);
+		mutex_destroy(&hid_data->fifo_lock);
+		mutex_destroy(&hid_data->lock);
+	}
+
+	pm_runtime_disable(&ctx->pci_dev->dev);
+	amd_sfh_debugfs_deinit(privdata);
+	amd_sfh_sched_deinit(privdata);
+	mutex_destroy(&privdata->cmd_lock);
+	put_device(&ctx->pci_dev->dev);
+}
+
+/* V1 firmware takes commands without acknowledging them */
+static void amd_sfh_test_cmd_v1(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	union amd_sfh_cmd cmd;
+	int rc;
+
+	privdata->version = AMD_SFH_TEST_HWID_V1;
+	rc = amd_sfh_start_sensor(ctx->pci_dev, GYRO_IDX,
+				  AMD_SFH_TEST_DMA_HANDLE, 100);
+	KUNIT_EXPECT_EQ(test, rc, 0);
+
+	cmd.ul = readl(privdata->mmio + AMD_C2P_MSG0);
+	KUNIT_EXPECT_EQ(test, (u32)cmd.cmd_v1.cmd_id,
+			(u32)AMD_SFH_CMD_ENABLE_SENSOR);
+	KUNIT_EXPECT_EQ(test, (u32)cmd.cmd_v1.sensor_id, (u32)GYRO_IDX);
+	KUNIT_EXPECT_EQ(test, (u32)cmd.cmd_v1.interval, 100U);
+	KUNIT_EXPECT_EQ(test, readq(privdata->mmio + AMD_C2P_MSG2),
+			(u64)AMD_SFH_TEST_DMA_HANDLE);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands, 1ULL);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.timeouts, 0ULL);
+}
+
+/* V2 firmware acknowledges enabling and disabling a sensor */
+static void amd_sfh_test_cmd_ack(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+
+	privdata->version = AMD_SFH_HWID_V2;
+	amd_sfh_test_start_mp2(test, 0);
+	KUNIT_EXPECT_EQ(test, amd_sfh_start_sensor(ctx->pci_dev, GYRO_IDX,
+						   AMD_SFH_TEST_DMA_HANDLE,
+						   100), 0);
+	KUNIT_EXPECT_EQ(test, amd_sfh_stop_sensor(ctx->pci_dev, GYRO_IDX), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->received), 2);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands, 2ULL);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.retries, 0ULL);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.timeouts, 0ULL);
+}
+
+/* A command the firmware did not answer in time is resent */
+static void amd_sfh_test_cmd_retry(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+
+	privdata->version = AMD_SFH_HWID_V2;
+	amd_sfh_test_start_mp2(test, 1);
+	KUNIT_EXPECT_EQ(test, amd_sfh_start_sensor(ctx->pci_dev, GYRO_IDX,
+						   AMD_SFH_TEST_DMA_HANDLE,
+						   100), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->received), 2);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.retries, 1ULL);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.timeouts, 0ULL);
+}
+
+/* The response to a former command does not acknowledge a new one */
+static void amd_sfh_test_cmd_stale(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	union amd_sfh_cmd_response resp;
+	int rc;
+
+	privdata->version = AMD_SFH_HWID_V2;
+	resp.ul = 0;
+	resp.s.response = AMD_SFH_RESP_SENSOR_ENABLED;
+	resp.s.sensor_id = GYRO_IDX;
+	writel(resp.ul, privdata->mmio + AMD_P2C_MSG0);
+
+	rc = amd_sfh_start_sensor(ctx->pci_dev, GYRO_IDX,
+				  AMD_SFH_TEST_DMA_HANDLE, 100);
+	KUNIT_EXPECT_EQ(test, rc, -ETIMEDOUT);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.retries,
+			(u64)AMD_SFH_CMD_RETRIES);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.timeouts, 1ULL);
+	KUNIT_EXPECT_EQ(test, readl(privdata->mmio + AMD_P2C_MSG0), 0U);
+}
+
+/* A sensor runs as long as its own device or a virtual sensor uses it */
+static void amd_sfh_test_get_put(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	struct amd_sfh_hid_data *hid_data;
+	int usage_count = amd_sfh_test_usage_count(test);
+
+	hid_data = amd_sfh_test_add_sensor(test, &amd_sfh_gyro_ops,
+					   AMD_SFH_TEST_HWID_V1);
+	KUNIT_ASSERT_EQ(test, amd_sfh_hid_ll_get(hid_data), 0);
+	KUNIT_ASSERT_EQ(test, amd_sfh_hid_ll_get(hid_data), 0);
+	KUNIT_ASSERT_EQ(test, amd_sfh_hid_ll_open(hid_data), 0);
+	KUNIT_EXPECT_EQ(test, hid_data->users, 2U);
+	KUNIT_EXPECT_EQ(test, hid_data->opens, 1U);
+	KUNIT_EXPECT_TRUE(test, hid_data->sampling);
+	KUNIT_EXPECT_FALSE(test, list_empty(&hid_data->sched_node));
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands, 1ULL);
+	KUNIT_EXPECT_EQ(test, amd_sfh_test_usage_count(test), usage_count + 3);
+
+	amd_sfh_hid_ll_put(hid_data);
+	amd_sfh_hid_ll_put(hid_data);
+	KUNIT_EXPECT_EQ(test, hid_data->users, 0U);
+	KUNIT_EXPECT_TRUE(test, hid_data->sampling);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands, 1ULL);
+
+	amd_sfh_hid_ll_close(hid_data);
+	KUNIT_EXPECT_EQ(test, hid_data->opens, 0U);
+	KUNIT_EXPECT_FALSE(test, hid_data->sampling);
+	KUNIT_EXPECT_TRUE(test, list_empty(&hid_data->sched_node));
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands, 2ULL);
+	KUNIT_EXPECT_EQ(test, amd_sfh_test_usage_count(test), usage_count);
+}
+
+/* A sensor that fails to start leaves no user and no PM reference behind */
+static void amd_sfh_test_get_error(struct kunit *test)
+{
+	struct amd_sfh_hid_data *hid_data;
+	int usage_count = amd_sfh_test_usage_count(test);
+
+	hid_data = amd_sfh_test_add_sensor(test, &amd_sfh_gyro_ops,
+					   AMD_SFH_HWID_V2);
+	KUNIT_EXPECT_EQ(test, amd_sfh_hid_ll_get(hid_data), -ETIMEDOUT);
+	KUNIT_EXPECT_EQ(test, hid_data->users, 0U);
+	KUNIT_EXPECT_FALSE(test, hid_data->sampling);
+	KUNIT_EXPECT_TRUE(test, list_empty(&hid_data->sched_node));
+	KUNIT_EXPECT_EQ(test, amd_sfh_test_usage_count(test), usage_count);
+}
+
+/* Concurrent opens and gets leave a stopped sensor behind */
+static void amd_sfh_test_race_open(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	struct amd_sfh_test_racer *racers;
+	struct amd_sfh_hid_data *hid_data;
+	int usage_count = amd_sfh_test_usage_count(test);
+	int i;
+
+	racers = kunit_kzalloc(test, sizeof(*racers) * AMD_SFH_TEST_RACERS,
+			       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, racers);
+	hid_data = amd_sfh_test_add_sensor(test, &amd_sfh_gyro_ops,
+					   AMD_SFH_HWID_V2);
+	privdata->irq = AMD_SFH_TEST_IRQ;
+	amd_sfh_test_start_mp2(test, 0);
+	for (i = 0; i < AMD_SFH_TEST_RACERS; i++) {
+		racers[i].hid_data = hid_data;
+		racers[i].own = i % 2;
+		INIT_WORK(&racers[i].work, amd_sfh_test_race);
+		queue_work(system_unbound_wq, &racers[i].work);
+	}
+
+	for (i = 0; i < AMD_SFH_TEST_RACERS; i++) {
+		flush_work(&racers[i].work);
+		KUNIT_EXPECT_EQ(test, racers[i].errors, 0);
+	}
+
+	KUNIT_EXPECT_EQ(test, hid_data->opens, 0U);
+	KUNIT_EXPECT_EQ(test, hid_data->users, 0U);
+	KUNIT_EXPECT_FALSE(test, hid_data->sampling);
+	KUNIT_EXPECT_TRUE(test, list_empty(&hid_data->sched_node));
+	KUNIT_EXPECT_EQ(test, amd_sfh_test_usage_count(test), usage_count);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.timeouts, 0ULL);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands % 2, 0ULL);
+}
+
+/* The module parameter overrides the quirks, which override the firmware */
+static void amd_sfh_test_sensor_mask(struct kunit *test)
+{
+	struct amd_sfh_quirks quirks = {
+		.sensor_mask = ACCEL_MASK | LID_MASK,
+	};
+
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(ACCEL_MASK, GYRO_MASK,
+							 &quirks),
+			(uint)GYRO_MASK);
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(ACCEL_MASK, 0,
+							 &quirks),
+			(uint)(ACCEL_MASK | LID_MASK));
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(ACCEL_MASK | ALS_MASK,
+							 0, NULL),
+			(uint)(ACCEL_MASK | ALS_MASK));
+}
+
+/* Without a sensors mask, only an override or a quirk provides sensors */
+static void amd_sfh_test_sensor_mask_zero(struct kunit *test)
+{
+	struct amd_sfh_quirks quirks = {
+		.sensor_mask = LID_MASK,
+	};
+
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(0, 0, NULL), 0U);
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(0, MAG_MASK, NULL),
+			(uint)MAG_MASK);
+	KUNIT_EXPECT_EQ(test, amd_sfh_select_sensor_mask(0, 0, &quirks),
+			(uint)LID_MASK);
+}
+
+/* Every sensor reads the sample the MP2 wrote to its buffer */
+static void amd_sfh_test_samples(struct kunit *test)
+{
+	const struct amd_sfh_test_sensor *expected;
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_hid_data *hid_data;
+	struct sensor_sample sample;
+	int i, j, rc, value;
+
+	amd_sfh_test_get_all(test);
+	for (i = 0; i < ctx->sensors; i++) {
+		expected = &amd_sfh_test_sensors[i];
+		hid_data = &ctx->hid_data[i];
+		rc = amd_sfh_hid_ll_get_sample(hid_data, &sample);
+		KUNIT_ASSERT_EQ(test, rc, 0);
+		KUNIT_EXPECT_EQ(test, sample.count, expected->count);
+		for (j = 0; j < expected->count; j++) {
+			value = expected->values[j];
+			if (amd_sfh_high_precision && expected->scaled & BIT(j))
+				value *= AMD_SFH_FW_MUL;
+
+			KUNIT_EXPECT_EQ(test, sample.values[j], value);
+		}
+	}
+
+	amd_sfh_test_put_all(test);
+}
+
+/* The interrupt of the MP2 delivers the reports of all signalled sensors */
+static void amd_sfh_test_irq(struct kunit *test)
+{
+	struct amd_sfh_test *ctx = test->priv;
+	struct amd_sfh_data *privdata = &ctx->privdata;
+	struct amd_sfh_stats *stats;
+	uint sensor_mask;
+	int i;
+
+	sensor_mask = amd_sfh_test_get_all(test);
+	KUNIT_EXPECT_EQ(test, readl(privdata->mmio + AMD_P2C_MSG_INTSTS),
+			sensor_mask);
+	for (i = 0; i < ctx->sensors; i++)
+		ctx->hid_data[i].stats.resume_time = ktime_get();
+
+	KUNIT_EXPECT_EQ(test, (int)amd_sfh_irq_handler(privdata->irq, privdata),
+			(int)IRQ_WAKE_THREAD);
+	KUNIT_EXPECT_EQ(test, readl(privdata->mmio + AMD_P2C_MSG_INTSTS), 0U);
+	KUNIT_EXPECT_EQ(test, privdata->irq_seen, sensor_mask);
+	KUNIT_EXPECT_EQ(test, (int)amd_sfh_irq_handler(privdata->irq, privdata),
+			(int)IRQ_NONE);
+
+	KUNIT_EXPECT_EQ(test, (int)amd_sfh_irq_thread(privdata->irq, privdata),
+			(int)IRQ_HANDLED);
+	KUNIT_EXPECT_EQ(test, atomic_read(&privdata->irq_status), 0);
+	for (i = 0; i < ctx->sensors; i++) {
+		stats = &ctx->hid_data[i].stats;
+		KUNIT_EXPECT_EQ(test, stats->resume_time, 0LL);
+		KUNIT_EXPECT_EQ(test, stats->errors, 0ULL);
+	}
+
+	amd_sfh_test_put_all(test);
+	KUNIT_EXPECT_EQ(test, privdata->cmd_stats.commands,
+			2ULL * ctx->sensors);
+}
+
+static struct kunit_case amd_sfh_test_cases[] = {
+	KUNIT_CASE(amd_sfh_test_cmd_v1),
+	KUNIT_CASE(amd_sfh_test_cmd_ack),
+	KUNIT_CASE(amd_sfh_test_cmd_retry),
+	KUNIT_CASE_SLOW(amd_sfh_test_cmd_stale),
+	KUNIT_CASE(amd_sfh_test_get_put),
+	KUNIT_CASE_SLOW(amd_sfh_test_get_error),
+	KUNIT_CASE(amd_sfh_test_race_open),
+	KUNIT_CASE(amd_sfh_test_sensor_mask),
+	KUNIT_CASE(amd_sfh_test_sensor_mask_zero),
+	KUNIT_CASE(amd_sfh_test_samples),
+	KUNIT_CASE(amd_sfh_test_irq),
+	{}
+};
+
+static struct kunit_suite amd_sfh_test_suite = {
+	.name = "amd-sfh",
+	.init = amd_sfh_test_init,
+	.exit = amd_sfh_test_exit,
+	.test_cases = amd_sfh_test_cases,
+};
+kunit_test_suite(amd_sfh_test_suite);
+
+MODULE_DESCRIPTION("AMD(R) Sensor Fusion Hub KUnit tests");
+MODULE_AUTHOR("Richard Neumann <mail@richard-neumann.de>");
+MODULE_LICENSE("Dual BSD/GPL");
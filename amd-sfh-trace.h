@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub tracepoints
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM amd_sfh
+
+#if !defined(AMD_SFH_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AMD_SFH_TRACE_H
+
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+#include "amd-sfh-pci.h"
+#include "sensors/amd-sfh-sensors.h"
+
+/*
+ * amd_sfh_cmd - A command written to the C2P mailbox registers.
+ * Decodes the command register according to the hardware version.
+ */
+TRACE_EVENT(amd_sfh_cmd,
+	TP_PROTO(u8 version, union amd_sfh_cmd cmd, union amd_sfh_parm parm,
+		 u64 dma_handle),
+	TP_ARGS(version, cmd, parm, dma_handle),
+
+	TP_STRUCT__entry(
+		__field(u8, version)
+		__field(u8, cmd_id)
+		__field(u8, sensor_id)
+		__field(u16, interval)
+		__field(u8, intr_enable)
+		__field(u8, length)
+		__field(u8, mem_type)
+		__field(u32, parm)
+		__field(u64, dma_handle)
+	),
+
+	TP_fast_assign(
+		__entry->version = version;
+		if (version == AMD_SFH_HWID_V2) {
+			__entry->cmd_id = cmd.cmd_v2.cmd_id;
+			__entry->sensor_id = cmd.cmd_v2.sensor_id;
+			__entry->interval = cmd.cmd_v2.interval;
+			__entry->intr_enable = cmd.cmd_v2.intr_enable;
+			__entry->length = cmd.cmd_v2.length;
+			__entry->mem_type = cmd.cmd_v2.mem_type;
+		} else {
+			__entry->cmd_id = cmd.cmd_v1.cmd_id;
+			__entry->sensor_id = cmd.cmd_v1.sensor_id;
+			__entry->interval = cmd.cmd_v1.interval;
+			__entry->intr_enable = 0;
+			__entry->length = 0;
+			__entry->mem_type = 0;
+		}
+		__entry->parm = parm.ul;
+		__entry->dma_handle = dma_handle;
+	),
+
+	TP_printk("v%u cmd=%u sensor=%u interval=%u intr=%u length=%u mem_type=%u parm=0x%08x dma=0x%llx",
+		  __entry->version, __entry->cmd_id, __entry->sensor_id,
+		  __entry->interval, __entry->intr_enable, __entry->length,
+		  __entry->mem_type, __entry->parm, __entry->dma_handle)
+);
+
+/*
+ * amd_sfh_cmd_done - Completion of a command written to the C2P mailbox.
+ * Records the result, the amount of retries and the round-trip time.
+ */
+TRACE_EVENT(amd_sfh_cmd_done,
+	TP_PROTO(u8 version, union amd_sfh_cmd cmd, int ret,
+		 unsigned int retries, s64 latency_ns),
+	TP_ARGS(version, cmd, ret, retries, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(u8, cmd_id)
+		__field(u8, sensor_id)
+		__field(int, ret)
+		__field(unsigned int, retries)
+		__field(s64, latency_ns)
+	),
+
+	TP_fast_assign(
+		if (version == AMD_SFH_HWID_V2) {
+			__entry->cmd_id = cmd.cmd_v2.cmd_id;
+			__entry->sensor_id = cmd.cmd_v2.sensor_id;
+		} else {
+			__entry->cmd_id = cmd.cmd_v1.cmd_id;
+			__entry->sensor_id = cmd.cmd_v1.sensor_id;
+		}
+		__entry->ret = ret;
+		__entry->retries = retries;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("cmd=%u sensor=%u ret=%d retries=%u latency_ns=%lld",
+		  __entry->cmd_id, __entry->sensor_id, __entry->ret,
+		  __entry->retries, __entry->latency_ns)
+);
+
+/*
+ * amd_sfh_poll - A wakeup of the sensor scheduler.
+ * Records the amount of polled sensors and the timer's lateness.
+ */
+TRACE_EVENT(amd_sfh_poll,
+	TP_PROTO(unsigned int polled, s64 lateness_ns),
+	TP_ARGS(polled, lateness_ns),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, polled)
+		__field(s64, lateness_ns)
+	),
+
+	TP_fast_assign(
+		__entry->polled = polled;
+		__entry->lateness_ns = lateness_ns;
+	),
+
+	TP_printk("polled=%u lateness_ns=%lld",
+		  __entry->polled, __entry->lateness_ns)
+);
+
+/*
+ * amd_sfh_raw_request - A request from the HID core.
+ * Records the sample values for input reports.
+ */
+TRACE_EVENT(amd_sfh_raw_request,
+	TP_PROTO(int sensor_idx, unsigned char reportnum, unsigned char rtype,
+		 int reqtype, int ret, const struct sensor_sample *sample),
+	TP_ARGS(sensor_idx, reportnum, rtype, reqtype, ret, sample),
+
+	TP_STRUCT__entry(
+		__field(int, sensor_idx)
+		__field(unsigned char, reportnum)
+		__field(unsigned char, rtype)
+		__field(int, reqtype)
+		__field(int, ret)
+		__field(u8, count)
+		__array(int, values, AMD_SFH_MAX_AXES)
+	),
+
+	TP_fast_assign(
+		__entry->sensor_idx = sensor_idx;
+		__entry->reportnum = reportnum;
+		__entry->rtype = rtype;
+		__entry->reqtype = reqtype;
+		__entry->ret = ret;
+		__entry->count = sample->count;
+		memcpy(__entry->values, sample->values,
+		       sizeof(__entry->values));
+	),
+
+	TP_printk("sensor=%d report=%u rtype=%u reqtype=%d ret=%d values=%s",
+		  __entry->sensor_idx, __entry->reportnum, __entry->rtype,
+		  __entry->reqtype, __entry->ret,
+		  __print_array(__entry->values, __entry->count, sizeof(int)))
+);
+
+/*
+ * amd_sfh_input_report - An input report pushed to the HID core.
+ */
+TRACE_EVENT(amd_sfh_input_report,
+	TP_PROTO(int sensor_idx, int len, const struct sensor_sample *sample),
+	TP_ARGS(sensor_idx, len, sample),
+
+	TP_STRUCT__entry(
+		__field(int, sensor_idx)
+		__field(int, len)
+		__field(u8, count)
+		__array(int, values, AMD_SFH_MAX_AXES)
+	),
+
+	TP_fast_assign(
+		__entry->sensor_idx = sensor_idx;
+		__entry->len = len;
+		__entry->count = sample->count;
+		memcpy(__entry->values, sample->values,
+		       sizeof(__entry->values));
+	),
+
+	TP_printk("sensor=%d len=%d values=%s",
+		  __entry->sensor_idx, __entry->len,
+		  __print_array(__entry->values, __entry->count, sizeof(int)))
+);
+
+DECLARE_EVENT_CLASS(amd_sfh_sensor,
+	TP_PROTO(int sensor_idx, u32 interval),
+	TP_ARGS(sensor_idx, interval),
+
+	TP_STRUCT__entry(
+		__field(int, sensor_idx)
+		__field(u32, interval)
+	),
+
+	TP_fast_assign(
+		__entry->sensor_idx = sensor_idx;
+		__entry->interval = interval;
+	),
+
+	TP_printk("sensor=%d interval=%u",
+		  __entry->sensor_idx, __entry->interval)
+);
+
+/*
+ * amd_sfh_open - A HID device was opened.
+ */
+DEFINE_EVENT(amd_sfh_sensor, amd_sfh_open,
+	TP_PROTO(int sensor_idx, u32 interval),
+	TP_ARGS(sensor_idx, interval)
+);
+
+/*
+ * amd_sfh_close - A HID device was closed.
+ */
+DEFINE_EVENT(amd_sfh_sensor, amd_sfh_close,
+	TP_PROTO(int sensor_idx, u32 interval),
+	TP_ARGS(sensor_idx, interval)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE amd-sfh-trace
+#include <trace/define_trace.h>
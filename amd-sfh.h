@@ -9,11 +9,38 @@
 #ifndef AMD_SFH_H
 #define AMD_SFH_H
 
+#include <linux/atomic.h>
 #include <linux/bits.h>
+#include <linux/debugfs.h>
+#include <linux/dma-mapping.h>
+#include <linux/export.h>
 #include <linux/hid.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
 #include <linux/pci.h>
 
 #define AMD_SFH_MAX_SENSORS	5
+#define AMD_SFH_MAX_VIRTUAL	4
+#define AMD_SFH_MAX_DEVICES	(AMD_SFH_MAX_SENSORS + AMD_SFH_MAX_VIRTUAL)
+#define AMD_SFH_HIST_BUCKETS	32
+
+/* The KUnit tests may be built as a module of their own */
+#if IS_ENABLED(CONFIG_AMD_SFH_KUNIT_TEST)
+#define AMD_SFH_VISIBLE_IF_KUNIT
+#define AMD_SFH_EXPORT_IF_KUNIT(symbol)	EXPORT_SYMBOL_GPL(symbol)
+#else
+#define AMD_SFH_VISIBLE_IF_KUNIT	static
+#define AMD_SFH_EXPORT_IF_KUNIT(symbol)
+#endif
+
+struct amd_sfh_fusion;
+struct amd_sfh_hid_data;
+struct amd_sfh_ring;
 
 /**
  * The sensor indices on the AMD SFH device
@@ -22,6 +49,13 @@
  * @MAG_IDX:	Index of the magnetometer
  * @LID_IDX:	Index of the lid switch
  * @ALS_IDX:	Index of the ambient light sensor
+ * @ORIENT_IDX:	Index of the virtual device orientation sensor
+ * @GRAVITY_IDX:	Index of the virtual gravity sensor
+ * @LINEAR_ACCEL_IDX:	Index of the virtual linear accelerometer
+ * @SCREEN_IDX:	Index of the virtual screen orientation sensor
+ *
+ * Virtual sensors are computed by the driver and use
+ * indices which are not assigned by the firmware.
  */
 enum sensor_idx {
 	ACCEL_IDX = 0,
@@ -29,6 +63,10 @@ enum sensor_idx {
 	MAG_IDX,
 	LID_IDX = 15,
 	ALS_IDX = 19,
+	ORIENT_IDX = 24,
+	GRAVITY_IDX,
+	LINEAR_ACCEL_IDX,
+	SCREEN_IDX,
 };
 
 /**
@@ -47,18 +85,85 @@ enum sensor_mask {
 	ALS_MASK = BIT(ALS_IDX),
 };
 
+/**
+ * struct amd_sfh_cmd_stats - Mailbox performance counters.
+ * @commands:	Commands sent to the firmware
+ * @retries:	Commands resent after a timeout
+ * @timeouts:	Commands the firmware did not acknowledge
+ * @latency:	log2 histogram of the commands' round-trip times
+ */
+struct amd_sfh_cmd_stats {
+	u64 commands;
+	u64 retries;
+	u64 timeouts;
+	u64 latency[AMD_SFH_HIST_BUCKETS];
+};
+
 /**
  * struct amd_sfh_data - AMD SFH driver data
  * @mmio:		iommapped registers
  * @pci_dev:		The AMD SFH PCI device
- * @sensors:		The HID devices for the corresponding sensors
+ * @sensors:		The HID device driver data of the physical and virtual sensors
  * @version:		SFH device version
+ * @dma_cpu_addr:	CPU address of the DMA memory shared by all sensors
+ * @dma_handle:		DMA handle of the DMA memory shared by all sensors
+ * @dma_used:		Bitmap of the claimed per-sensor DMA slots
+ * @cmd_lock:		Serializes commands to the firmware
+ * @cmd_stats:		Mailbox performance counters
+ * @irq:		Interrupt line or zero if sensors are polled
+ * @irq_status:		Latched interrupt status pending delivery
+ * @irq_seen:		Interrupt status bits seen since the probe
+ * @irq_time:		Time of the last interrupt
+ * @sched_timer:	Timer waking up the scheduler at the next deadline
+ * @sched_worker:	High-priority worker polling the sensors
+ * @sched_work:		Work polling all due sensors
+ * @sched_list:		HID device driver data of the polled sensors
+ * @sched_lock:		Protects the list of polled sensors
+ * @debugfs:		debugfs directory of the SFH
+ * @ring:		Shared sample ring or NULL if unavailable
+ * @fusion:		State of the virtual sensors or NULL if unavailable
  */
 struct amd_sfh_data {
 	void __iomem *mmio;
 	struct pci_dev *pci_dev;
-	struct hid_device *sensors[AMD_SFH_MAX_SENSORS];
+	struct amd_sfh_hid_data *sensors[AMD_SFH_MAX_DEVICES];
 	u8 version;
+	void *dma_cpu_addr;
+	dma_addr_t dma_handle;
+	unsigned long dma_used;
+	struct mutex cmd_lock;
+	struct amd_sfh_cmd_stats cmd_stats;
+	int irq;
+	atomic_t irq_status;
+	u32 irq_seen;
+	ktime_t irq_time;
+	struct hrtimer sched_timer;
+	struct kthread_worker *sched_worker;
+	struct kthread_work sched_work;
+	struct list_head sched_list;
+	struct mutex sched_lock;
+	struct dentry *debugfs;
+	struct amd_sfh_ring *ring;
+	struct amd_sfh_fusion *fusion;
 };
 
+/**
+ * amd_sfh_hist_add - Records a duration in a log2 histogram.
+ * @hist:	Histogram with AMD_SFH_HIST_BUCKETS buckets
+ * @delta:	Duration to record
+ *
+ * Bucket n holds durations of [2^n, 2^(n+1)) nanoseconds.
+ * Negative durations are recorded in the first bucket.
+ */
+static inline void amd_sfh_hist_add(u64 *hist, ktime_t delta)
+{
+	s64 ns = ktime_to_ns(delta);
+	int bucket = 0;
+
+	if (ns > 0)
+		bucket = min(ilog2(ns), AMD_SFH_HIST_BUCKETS - 1);
+
+	hist[bucket]++;
+}
+
 #endif
@@ -23,6 +23,7 @@ struct feature_report {
 struct input_report {
 	struct common_inputs common;
 	int illuminance;
+	u64 timestamp;
 } __packed;
 
 static u8 report_descriptor[] = {
@@ -94,6 +95,13 @@ static u8 report_descriptor[] = {
 0x95, 1,		/* HID report count(1) */
 0x55, 0,		/* HID unit exponent(0) */
 0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x1B, 0x03,	/* HID usage sensor property report latency */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF,	/* HID logical Max_32 */
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0,		/* HID unit exponent(0) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
 0x0A, 0xD1, 0xE4,	/* Light illuminance and sensitivity REL PCT) */
 0x15, 0,		/* HID logical Min_8(0) */
 0x26, 0x10, 0x27,	/* HID logical Max_16(0x10,0x27) */
@@ -154,73 +162,135 @@ static u8 report_descriptor[] = {
 0x75, 32,		/* HID report size(32) */
 0x95, 1,		/* HID report count (1) */
 0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
+0x0A, 0x29, 0x05,	/* HID usage sensor time timestamp */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF, /* HID logical Max_32 (unsigned) */
+0x75, 64,		/* HID report size(64) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0xF7,		/* HID unit exponent(-9) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
 0xC0			/* HID end collection */
 };
 /**
  * get_als_feature_report - Get ambient light sensor feature report.
  * @reportnum:		Report number
  * @buf:		Report buffer
- * @size:		Size of the report buffer
+ * @len:		Size of the report buffer
+ * @settings:		Current sensor settings
  *
- * Writes a feature report for the accelerometer to the report buffer.
+ * Writes a feature report for the ambient light sensor to the report buffer.
  *
  * Returns the amout of bytes written on success or < zero on errors.
  */
-int get_als_feature_report(int reportnum, u8 *buf, size_t len)
+static int get_als_feature_report(int reportnum, u8 *buf, size_t len,
+				  const struct sensor_settings *settings)
 {
 	struct feature_report report;
 
-	report.change_sesnitivity = AMD_SFH_DEFAULT_SENSITIVITY;
+	report.change_sesnitivity = settings->sensitivity[0];
 	report.sensitivity_min = AMD_SFH_DEFAULT_MIN_VALUE;
 	report.sensitivity_max = AMD_SFH_DEFAULT_MAX_VALUE;
-	set_common_features(&report.common, reportnum);
+	set_common_features(&report.common, reportnum, settings);
 
+	len = min(len, sizeof(report));
 	memcpy(buf, &report, len);
 	return len;
 }
+
 /**
- * get_als_input_report - Get ambient light sensor input report.
- * @reportnum:		Report number
+ * set_als_feature_report - Set ambient light sensor feature report.
  * @buf:		Report buffer
  * @len:		Size of the report buffer
- * @cpu_addr:		DMA-mapped CPU address
+ * @settings:		Sensor settings to update
  *
- * Writes an input report for the accelerometer to the report buffer.
+ * Reads the settings for the ambient light sensor from a feature report.
  *
- * Returns the amout of bytes written on success or < zero on errors.
+ * Returns 0 on success or < zero on errors.
  */
-int get_als_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr,
-			 struct pci_dev *pci_dev, u8 version)
+static int set_als_feature_report(const u8 *buf, size_t len,
+				  struct sensor_settings *settings)
 {
-	struct input_report report;
+	struct feature_report report;
+	int i, rc;
 
+	rc = parse_common_features(buf, len, settings);
+	if (rc || len < sizeof(report))
+		return rc;
+
+	memcpy(&report, buf, sizeof(report));
+	for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+		settings->sensitivity[i] = report.change_sesnitivity;
+
+	return 0;
+}
+
+/**
+ * get_als_sample - Get ambient light sensor sample.
+ * @cpu_addr:		DMA-mapped CPU address
+ * @pci_dev:		Sensor Fusion Hub PCI device
+ * @version:		SFH hardware version
+ * @sample:		Sample to fill
+ *
+ * Reads the current values of the ambient light sensor from the DRAM.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int get_als_sample(u32 *cpu_addr, struct pci_dev *pci_dev, u8 version,
+			  struct sensor_sample *sample)
+{
 	if (!cpu_addr)
 		return -EIO;
 
 	switch (version) {
 	case AMD_SFH_HWID_V2:
-		report.illuminance = amd_sfh_get_illuminance(pci_dev);
+		sample->values[0] = amd_sfh_get_illuminance(pci_dev);
+		if (amd_sfh_high_precision)
+			sample->values[0] *= AMD_SFH_FW_MUL;
+
 		break;
 	default:
-		report.illuminance = (int)cpu_addr[0] / AMD_SFH_FW_MUL;
+		sample->values[0] = fw_value(cpu_addr[0]);
 		break;
 	}
 
-	set_common_inputs(&report.common, reportnum);
-	memcpy(buf, &report, len);
-	return len;
+	sample->count = 1;
+	return 0;
 }
 
 /**
- * parse_als_descriptor - Parse the HID descriptor for the ambient light sensor.
- * @hid:	HID device
+ * get_als_input_report - Get ambient light sensor input report.
+ * @reportnum:		Report number
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @sample:		Sensor sample
  *
- * This function gets called during call to hid_add_device().
+ * Writes an input report for the ambient light sensor to the report buffer.
  *
- * Returns 0 on success and non-zero on errors.
+ * Returns the amout of bytes written on success or < zero on errors.
  */
-int parse_als_descriptor(struct hid_device *hid)
+static int get_als_input_report(int reportnum, u8 *buf, size_t len,
+				const struct sensor_sample *sample)
 {
-	return hid_parse_report(hid, report_descriptor,
-				sizeof(report_descriptor));
+	struct input_report report;
+
+	report.illuminance = sample->values[0];
+	report.timestamp = sample->timestamp;
+	set_common_inputs(&report.common, reportnum);
+
+	len = min(len, sizeof(report));
+	memcpy(buf, &report, len);
+	return len;
 }
+
+const struct amd_sfh_sensor_ops amd_sfh_als_ops = {
+	.sensor_idx = ALS_IDX,
+	.name = "ambient light sensor",
+	.debugfs_name = "als",
+	.descriptor = report_descriptor,
+	.descriptor_size = sizeof(report_descriptor),
+	.get_feature_report = get_als_feature_report,
+	.set_feature_report = set_als_feature_report,
+	.get_sample = get_als_sample,
+	.get_input_report = get_als_input_report,
+};
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_als_ops);
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ * AMD Sensor Fusion Hub gravity functions
+ *
+ * The gravity is a virtual sensor, which is computed from the
+ * accelerometer and, if available, the gyroscope.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/hid.h>
+#include <linux/types.h>
+
+#include "amd-sfh-sensors.h"
+
+struct feature_report {
+	struct common_features common;
+	u16 change_sesnitivity;
+	s16 sensitivity_max;
+	s16 sensitivity_min;
+} __packed;
+
+struct input_report {
+	struct common_inputs common;
+	int accel_x;
+	int accel_y;
+	int accel_z;
+	u64 timestamp;
+} __packed;
+
+static u8 report_descriptor[] = {
+0x05, 0x20,		/* Usage page */
+0x09, 0x7B,		/* Motion type Gravity vector */
+0xA1, 0x00,		/* HID Collection (Physical) */
+
+//feature reports(xmit/receive)
+0x85, 1,		/* HID  Report ID */
+0x05, 0x20,		/* HID usage page sensor */
+0x0A, 0x09, 0x03,	/* Sensor property and sensor connection type */
+0x15, 0,		/* HID logical MIN_8(0) */
+0x25, 2,		/* HID logical MAX_8(2) */
+0x75, 8,		/* HID report size(8) */
+0x95, 1,		/* HID report count(1) */
+0xA1, 0x02,		/* HID collection (logical) */
+0x0A, 0x30, 0x08,	/* Sensor property connection type intergated sel*/
+0x0A, 0x31, 0x08,	/* Sensor property connection type attached sel */
+0x0A, 0x32, 0x08,	/* Sensor property connection type external sel */
+0xB1, 0x00,		/* HID feature (Data_Arr_Abs) */
+0xC0,			/* HID end collection */
+0x0A, 0x16, 0x03,	/* HID usage sensor property reporting state */
+0x15, 0,		/* HID logical Min_8(0) */
+0x25, 5,		/* HID logical Max_8(5) */
+0x75, 8,		/* HID report size(8) */
+0x95, 1,		/* HID report count(1) */
+0xA1, 0x02,		/* HID collection(logical) */
+0x0A, 0x40, 0x08,	/* Sensor property report state no events sel */
+0x0A, 0x41, 0x08,	/* Sensor property report state all events sel */
+0x0A, 0x42, 0x08,	/* Sensor property report state threshold events sel */
+0x0A, 0x43, 0x08,	/* Sensor property report state no events wake sel */
+0x0A, 0x44, 0x08,	/* Sensor property report state all events wake sel */
+0x0A, 0x45, 0x08,	/* Sensor property report state threshold events wake sel */
+0xB1, 0x00,		/* HID feature (Data_Arr_Abs) */
+0xC0,			/* HID end collection */
+0x0A, 0x19, 0x03,	/* HID usage sensor property power state */
+0x15, 0,		/* HID logical Min_8(0) */
+0x25, 5,		/* HID logical Max_8(5) */
+0x75, 8,		/* HID report size(8) */
+0x95, 1,		/* HID report count(1) */
+0xA1, 0x02,		/* HID collection(logical) */
+0x0A, 0x50, 0x08,	/* Sensor property power state undefined sel */
+0x0A, 0x51, 0x08,	/* Sensor property power state D0 full power  sel */
+0x0A, 0x52, 0x08,	/* Sensor property power state D1 low power sel */
+0x0A, 0x53, 0x08,	/* Sensor property power state D2 standby with wake sel */
+0x0A, 0x54, 0x08,	/* Sensor property power state D3 sleep with wake  sel */
+0x0A, 0x55, 0x08,	/* Sensor property power state D4 power off sel */
+0xB1, 0x00,		/* HID feature (Data_Arr_Abs) */
+0xC0,			/* HID end collection */
+0x0A, 0x01, 0x02,	/* HID usage sensor state */
+0x15, 0,		/* HID logical Min_8(0) */
+0x25, 6,		/* HID logical Max_8(6) */
+0x75, 8,		/* HID report size(8) */
+0x95, 1,		/* HID report count(1) */
+0xA1, 0x02,		/* HID collection(logical) */
+0x0A, 0x00, 0x08,	/* HID usage sensor state unknown sel */
+0x0A, 0x01, 0x08,	/* HID usage sensor state ready sel */
+0x0A, 0x02, 0x08,	/* HID usage sensor state not available sel */
+0x0A, 0x03, 0x08,	/* HID usage sensor state no data sel */
+0x0A, 0x04, 0x08,	/* HID usage sensor state initializing sel */
+0x0A, 0x05, 0x08,	/* HID usage sensor state access denied sel */
+0x0A, 0x06, 0x08,	/* HID usage sensor state error sel */
+0xB1, 0x00,		/* HID feature (Data_Arr_Abs) */
+0xC0,			/* HID end collection */
+0x0A, 0x0E, 0x03,	/* HID usage sensor property report interval */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF, /* HID logical Max_32 */
+
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0,		/* HID unit exponent(0) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x1B, 0x03,	/* HID usage sensor property report latency */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF,	/* HID logical Max_32 */
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0,		/* HID unit exponent(0) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x52, 0x14,	/* Sensor data motion accel and mod change sensitivity ABS) */
+
+0x15, 0,		/* HID logical Min_8(0) */
+0x26, 0xFF, 0xFF,	/* HID logical Max_16(0xFF,0xFF) */
+
+0x75, 16,		/* HID report size(16) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x52, 0x24,	/* HID usage sensor data (motion accel and mod max) */
+
+0x16, 0x01, 0x80,	/* HID logical Min_16(0x01,0x80) */
+
+0x26, 0xFF, 0x7F,	/* HID logical Max_16(0xFF,0x7F) */
+
+0x75, 16,		/* HID report size(16) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x52, 0x34,	/* HID usage sensor data (motion accel and mod min) */
+
+0x16, 0x01, 0x80,	/* HID logical Min_16(0x01,0x80) */
+
+0x26, 0xFF, 0x7F,	/* HID logical Max_16(0xFF,0x7F) */
+
+0x75, 16,		/* HID report size(16) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+
+//input report (transmit)
+0x05, 0x20,		 /* HID usage page sensors */
+0x0A, 0x01, 0x02,	 /* HID usage sensor state */
+0x15, 0,		 /* HID logical Min_8(0) */
+0x25, 6,		 /* HID logical Max_8(6) */
+0x75, 8,		 /* HID report size(8) */
+0x95, 1,		 /* HID report count (1) */
+0xA1, 0x02,		 /* HID end collection (logical) */
+0x0A, 0x00, 0x08,	 /* HID usage sensor state unknown sel */
+0x0A, 0x01, 0x08,	 /* HID usage sensor state ready sel */
+0x0A, 0x02, 0x08,	 /* HID usage sensor state not available sel */
+0x0A, 0x03, 0x08,	 /* HID usage sensor state no data sel */
+0x0A, 0x04, 0x08,	 /* HID usage sensor state initializing sel */
+0x0A, 0x05, 0x08,	 /* HID usage sensor state access denied sel */
+0x0A, 0x06, 0x08,	 /* HID usage sensor state error sel */
+0X81, 0x00,		 /* HID Input (Data_Arr_Abs) */
+0xC0,			 /* HID end collection */
+0x0A, 0x02, 0x02,	 /* HID usage sensor event */
+0x15, 0,		 /* HID logical Min_8(0) */
+0x25, 5,		 /* HID logical Max_8(5) */
+0x75, 8,		 /* HID report size(8) */
+0x95, 1,		 /* HID report count (1) */
+0xA1, 0x02,		 /* HID end collection (logical) */
+0x0A, 0x10, 0x08,	 /* HID usage sensor event unknown sel */
+0x0A, 0x11, 0x08,	 /* HID usage sensor event state changed sel */
+0x0A, 0x12, 0x08,	 /* HID usage sensor event property changed sel */
+0x0A, 0x13, 0x08,	 /* HID usage sensor event data updated sel */
+0x0A, 0x14, 0x08,	 /* HID usage sensor event poll response sel */
+0x0A, 0x15, 0x08,	 /* HID usage sensor event change sensitivity sel */
+0X81, 0x00,		 /* HID Input (Data_Arr_Abs) */
+0xC0,			 /* HID end collection */
+0x0A, 0x53, 0x04,	 /* HID usage sensor data motion Acceleration X axis */
+0x17, 0x01, 0x00, 0x00, 0x80, /* HID logical Min_32 */
+
+0x27, 0xFF, 0xFF, 0xFF, 0x7F, /* HID logical Max_32 */
+
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
+0x0A, 0x54, 0x04,	/* HID usage sensor data motion Acceleration Y axis */
+0x17, 0x01, 0x00, 0x00, 0x80, /* HID logical Min_32 */
+
+0x27, 0xFF, 0xFF, 0xFF, 0x7F, /* HID logical Max_32 */
+
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
+0x0A, 0x55, 0x04,	/* HID usage sensor data motion Acceleration Z axis */
+0x17, 0x01, 0x00, 0x00, 0x80, /* HID logical Min_32 */
+
+0x27, 0xFF, 0xFF, 0xFF, 0x7F, /* HID logical Max_32 */
+
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0x0E,		/* HID unit exponent(0x0E) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
+
+
+0x0A, 0x29, 0x05,	/* HID usage sensor time timestamp */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF, /* HID logical Max_32 (unsigned) */
+0x75, 64,		/* HID report size(64) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0xF7,		/* HID unit exponent(-9) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
+0xC0			/* HID end collection */
+};
+
+/**
+ * get_gravity_feature_report - Get gravity vector feature report.
+ * @reportnum:		Report number
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @settings:		Current sensor settings
+ *
+ * Writes a feature report for the gravity vector to the report buffer.
+ *
+ * Returns the amout of bytes written on success or < zero on errors.
+ */
+static int get_gravity_feature_report(int reportnum, u8 *buf, size_t len,
+				      const struct sensor_settings *settings)
+{
+	struct feature_report report;
+
+	report.change_sesnitivity = settings->sensitivity[0];
+	report.sensitivity_min = AMD_SFH_DEFAULT_MIN_VALUE;
+	report.sensitivity_max = AMD_SFH_DEFAULT_MAX_VALUE;
+	set_common_features(&report.common, reportnum, settings);
+
+	len = min(len, sizeof(report));
+	memcpy(buf, &report, len);
+	return len;
+}
+
+/**
+ * set_gravity_feature_report - Set gravity vector feature report.
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @settings:		Sensor settings to update
+ *
+ * Reads the settings for the gravity vector from a feature report.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int set_gravity_feature_report(const u8 *buf, size_t len,
+				      struct sensor_settings *settings)
+{
+	struct feature_report report;
+	int i, rc;
+
+	rc = parse_common_features(buf, len, settings);
+	if (rc || len < sizeof(report))
+		return rc;
+
+	memcpy(&report, buf, sizeof(report));
+	for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+		settings->sensitivity[i] = report.change_sesnitivity;
+
+	return 0;
+}
+
+/**
+ * get_gravity_input_report - Get gravity vector input report.
+ * @reportnum:		Report number
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @sample:		Sensor sample
+ *
+ * Writes an input report for the gravity vector to the report buffer.
+ *
+ * Returns the amout of bytes written on success or < zero on errors.
+ */
+static int get_gravity_input_report(int reportnum, u8 *buf, size_t len,
+				    const struct sensor_sample *sample)
+{
+	struct input_report report;
+
+	report.accel_x = sample->values[0];
+	report.accel_y = sample->values[1];
+	report.accel_z = sample->values[2];
+	report.timestamp = sample->timestamp;
+	set_common_inputs(&report.common, reportnum);
+
+	len = min(len, sizeof(report));
+	memcpy(buf, &report, len);
+	return len;
+}
+
+const struct amd_sfh_sensor_ops amd_sfh_gravity_ops = {
+	.sensor_idx = GRAVITY_IDX,
+	.name = "gravity",
+	.debugfs_name = "gravity",
+	.descriptor = report_descriptor,
+	.descriptor_size = sizeof(report_descriptor),
+	.sources = ACCEL_MASK,
+	.optional_sources = GYRO_MASK,
+	.get_feature_report = get_gravity_feature_report,
+	.set_feature_report = set_gravity_feature_report,
+	.get_input_report = get_gravity_input_report,
+};
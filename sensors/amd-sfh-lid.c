@@ -42,57 +42,98 @@ static u8 report_descriptor[] = {
  * get_lid_feature_report - Get lid switch feature report.
  * @reportnum:		Report number
  * @buf:		Report buffer
- * @size:		Size of the report buffer
+ * @len:		Size of the report buffer
+ * @settings:		Current sensor settings
  *
  * Writes a feature report for the lid switch to the report buffer.
  *
  * Returns the amout of bytes written on success or < zero on errors.
  */
-int get_lid_feature_report(int reportnum, u8 *buf, size_t len)
+static int get_lid_feature_report(int reportnum, u8 *buf, size_t len,
+				  const struct sensor_settings *settings)
 {
 	struct feature_report report;
 
-	set_common_features(&report.common, reportnum);
+	set_common_features(&report.common, reportnum, settings);
 
+	len = min(len, sizeof(report));
 	memcpy(buf, &report, len);
 	return len;
 }
 
 /**
- * get_lid_input_report - Get lid switch input report.
- * @reportnum:		Report number
+ * set_lid_feature_report - Set lid switch feature report.
  * @buf:		Report buffer
  * @len:		Size of the report buffer
- * @cpu_addr:		DMA-mapped CPU address
+ * @settings:		Sensor settings to update
  *
- * Writes an input report for the lid switch to the report buffer.
+ * Reads the settings for the lid switch from a feature report.
  *
- * Returns the amout of bytes written on success or < zero on errors.
+ * Returns 0 on success or < zero on errors.
  */
-int get_lid_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr)
+static int set_lid_feature_report(const u8 *buf, size_t len,
+				  struct sensor_settings *settings)
 {
-	struct input_report report;
+	return parse_common_features(buf, len, settings);
+}
 
+/**
+ * get_lid_sample - Get lid switch sample.
+ * @cpu_addr:		DMA-mapped CPU address
+ * @pci_dev:		Unused
+ * @version:		Unused
+ * @sample:		Sample to fill
+ *
+ * Reads the current state of the lid switch from the DRAM.
+ * The sample's only value is 1 if the lid is closed and 0 otherwise.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int get_lid_sample(u32 *cpu_addr, struct pci_dev *pci_dev, u8 version,
+			  struct sensor_sample *sample)
+{
 	if (!cpu_addr)
 		return -EIO;
 
-	//report.state = (int)cpu_addr[0] / AMD_SFH_FW_MUL;
-	set_common_inputs(&report.common, reportnum);
-
-	memcpy(buf, &report, len);
-	return len;
+	/* The firmware writes a non-zero state while the lid is closed */
+	sample->values[0] = cpu_addr[0] != 0;
+	sample->count = 1;
+	return 0;
 }
 
 /**
- * parse_lid_descriptor - Parse the HID descriptor for the lid switch.
- * @hid:	HID device
+ * get_lid_input_report - Get lid switch input report.
+ * @reportnum:		Report number
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @sample:		Sensor sample
  *
- * This function gets called during call to hid_add_device().
+ * Writes an input report for the lid switch to the report buffer.
  *
- * Returns 0 on success and non-zero on errors.
+ * Returns the amout of bytes written on success or < zero on errors.
  */
-int parse_lid_descriptor(struct hid_device *hid)
+static int get_lid_input_report(int reportnum, u8 *buf, size_t len,
+				const struct sensor_sample *sample)
 {
-	return hid_parse_report(hid, report_descriptor,
-				sizeof(report_descriptor));
+	struct input_report report;
+
+	report.state = sample->values[0];
+	set_common_inputs(&report.common, reportnum);
+
+	len = min(len, sizeof(report));
+	memcpy(buf, &report, len);
+	return len;
 }
+
+const struct amd_sfh_sensor_ops amd_sfh_lid_ops = {
+	.sensor_idx = LID_IDX,
+	.name = "lid switch",
+	.debugfs_name = "lid",
+	.descriptor = report_descriptor,
+	.descriptor_size = sizeof(report_descriptor),
+	.get_feature_report = get_lid_feature_report,
+	.set_feature_report = set_lid_feature_report,
+	.get_sample = get_lid_sample,
+	.get_input_report = get_lid_input_report,
+};
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_lid_ops);
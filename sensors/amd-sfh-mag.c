@@ -27,6 +27,7 @@ struct input_report {
 	int flux_y;
 	int flux_z;
 	int accuracy;
+	u64 timestamp;
 } __packed;
 
 static u8 report_descriptor[] = {
@@ -97,6 +98,13 @@ static u8 report_descriptor[] = {
 0x95, 1,		/* HID report count(1) */
 0x55, 0,		/* HID unit exponent(0) */
 0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
+0x0A, 0x1B, 0x03,	/* HID usage sensor property report latency */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF,	/* HID logical Max_32 */
+0x75, 32,		/* HID report size(32) */
+0x95, 1,		/* HID report count(1) */
+0x55, 0,		/* HID unit exponent(0) */
+0xB1, 0x02,		/* HID feature (Data_Arr_Abs) */
 0x0A, 0x71, 0x14,	/* Orientation  and mod change sensitivity ABS)*/
 0x15, 0,		/* HID logical Min_8(0) */
 0x26, 0xFF, 0xFF,	/* HID logical Max_16(0xFF,0xFF) */
@@ -197,7 +205,15 @@ static u8 report_descriptor[] = {
 0x27, 0xFF, 0xFF, 0xFF, 0x7F,	/* HID logical Max_32 */
 0x75, 32,			/* HID report size(32) */
 0x95, 1,			/* HID report count (1) */
+0x55, 0,			/* HID unit exponent(0) */
 0X81, 0x02,			/* HID Input (Data_Arr_Abs) */
+0x0A, 0x29, 0x05,	/* HID usage sensor time timestamp */
+0x15, 0,		/* HID logical Min_8(0) */
+0x27, 0xFF, 0xFF, 0xFF, 0xFF, /* HID logical Max_32 (unsigned) */
+0x75, 64,		/* HID report size(64) */
+0x95, 1,		/* HID report count (1) */
+0x55, 0xF7,		/* HID unit exponent(-9) */
+0X81, 0x02,		/* HID Input (Data_Arr_Abs) */
 0xC0				/* HID end collection */
 };
 
@@ -206,64 +222,121 @@ static u8 report_descriptor[] = {
  * @reportnum:		Report number
  * @buf:		Report buffer
  * @len:		Size of the report buffer
+ * @settings:		Current sensor settings
  *
  * Writes a feature report for the magnetometer to the report buffer.
  *
  * Returns the amout of bytes written on success or < zero on errors.
  */
-int get_mag_feature_report(int reportnum, u8 *buf, size_t len)
+static int get_mag_feature_report(int reportnum, u8 *buf, size_t len,
+				  const struct sensor_settings *settings)
 {
 	struct feature_report report;
 
 	report.heading_min = AMD_SFH_DEFAULT_MIN_VALUE;
 	report.heading_max = AMD_SFH_DEFAULT_MAX_VALUE;
-	report.flux_change_sensitivity = AMD_SFH_DEFAULT_SENSITIVITY;
+	report.flux_change_sensitivity = settings->sensitivity[0];
 	report.flux_min = AMD_SFH_DEFAULT_MIN_VALUE;
 	report.flux_max = AMD_SFH_DEFAULT_MAX_VALUE;
-	set_common_features(&report.common, reportnum);
+	set_common_features(&report.common, reportnum, settings);
 
+	len = min(len, sizeof(report));
 	memcpy(buf, &report, len);
 	return len;
 }
 
 /**
- * get_mag_input_report - Get magnetometer input report.
- * @reportnum:		Report number
+ * set_mag_feature_report - Set magnetometer feature report.
  * @buf:		Report buffer
  * @len:		Size of the report buffer
- * @cpu_addr:		DMA-mapped CPU address
+ * @settings:		Sensor settings to update
  *
- * Writes a input report for the magnetometer to the report buffer.
+ * Reads the settings for the magnetometer from a feature report.
  *
- * Returns the amout of bytes written on success or < zero on errors.
+ * Returns 0 on success or < zero on errors.
  */
-int get_mag_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr)
+static int set_mag_feature_report(const u8 *buf, size_t len,
+				  struct sensor_settings *settings)
 {
-	struct input_report report;
+	struct feature_report report;
+	int i, rc;
+
+	rc = parse_common_features(buf, len, settings);
+	if (rc || len < sizeof(report))
+		return rc;
+
+	memcpy(&report, buf, sizeof(report));
+	for (i = 0; i < AMD_SFH_DATA_AXES; i++)
+		settings->sensitivity[i] = report.flux_change_sensitivity;
 
+	/* Changes of the accuracy are always reported */
+	settings->sensitivity[AMD_SFH_DATA_AXES] = 0;
+
+	return 0;
+}
+
+/**
+ * get_mag_sample - Get magnetometer sample.
+ * @cpu_addr:		DMA-mapped CPU address
+ * @pci_dev:		Unused
+ * @version:		Unused
+ * @sample:		Sample to fill
+ *
+ * Reads the current values of the magnetometer from the DRAM.
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static int get_mag_sample(u32 *cpu_addr, struct pci_dev *pci_dev, u8 version,
+			  struct sensor_sample *sample)
+{
 	if (!cpu_addr)
 		return -EIO;
 
-	report.flux_x = (int)cpu_addr[0] / AMD_SFH_FW_MUL;
-	report.flux_y = (int)cpu_addr[1] / AMD_SFH_FW_MUL;
-	report.flux_z = (int)cpu_addr[2] / AMD_SFH_FW_MUL;
-	report.accuracy = (u16)cpu_addr[3] / AMD_SFH_FW_MUL;
-	set_common_inputs(&report.common, reportnum);
-
-	memcpy(buf, &report, len);
-	return len;
+	sample->values[0] = fw_value(cpu_addr[0]);
+	sample->values[1] = fw_value(cpu_addr[1]);
+	sample->values[2] = fw_value(cpu_addr[2]);
+	sample->values[3] = (u16)cpu_addr[3] / AMD_SFH_FW_MUL;
+	sample->count = 4;
+	return 0;
 }
 
 /**
- * parse_mag_descriptor - Parse the HID descriptor for the magnetometer.
- * @hid:	HID device
+ * get_mag_input_report - Get magnetometer input report.
+ * @reportnum:		Report number
+ * @buf:		Report buffer
+ * @len:		Size of the report buffer
+ * @sample:		Sensor sample
  *
- * This function gets called during call to hid_add_device().
+ * Writes an input report for the magnetometer to the report buffer.
  *
- * Returns 0 on success and non-zero on errors.
+ * Returns the amout of bytes written on success or < zero on errors.
  */
-int parse_mag_descriptor(struct hid_device *hid)
+static int get_mag_input_report(int reportnum, u8 *buf, size_t len,
+				const struct sensor_sample *sample)
 {
-	return hid_parse_report(hid, report_descriptor,
-				sizeof(report_descriptor));
+	struct input_report report;
+
+	report.flux_x = sample->values[0];
+	report.flux_y = sample->values[1];
+	report.flux_z = sample->values[2];
+	report.accuracy = sample->values[3];
+	report.timestamp = sample->timestamp;
+	set_common_inputs(&report.common, reportnum);
+
+	len = min(len, sizeof(report));
+	memcpy(buf, &report, len);
+	return len;
 }
+
+const struct amd_sfh_sensor_ops amd_sfh_mag_ops = {
+	.sensor_idx = MAG_IDX,
+	.name = "magnetometer",
+	.debugfs_name = "mag",
+	.descriptor = report_descriptor,
+	.descriptor_size = sizeof(report_descriptor),
+	.get_feature_report = get_mag_feature_report,
+	.set_feature_report = set_mag_feature_report,
+	.get_sample = get_mag_sample,
+	.get_input_report = get_mag_input_report,
+};
+AMD_SFH_EXPORT_IF_KUNIT(amd_sfh_mag_ops);
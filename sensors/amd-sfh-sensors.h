@@ -16,11 +16,18 @@
 #include <linux/types.h>
 #include <linux/workqueue.h>
 
+#include "../amd-sfh.h"
+
 #define AMD_SFH_FW_MUL			1000
+#define AMD_SFH_FW_MUL_EXP		3
+#define AMD_SFH_MAX_REPORT_SIZE		64
+#define AMD_SFH_INPUT_REPORT_ID		1
+#define AMD_SFH_FEATURE_REPORT_ID	1
+#define AMD_SFH_MAX_AXES		4
+#define AMD_SFH_DATA_AXES		3
 #define AMD_SFH_CONNECTION_TYPE		0x01
 #define AMD_SFH_REPORT_STATE		0x41
 #define AMD_SFH_POWER_STATE		0x51
-#define AMD_SFH_REPORT_INTERVAL		0x50
 #define AMD_SFH_EVENT_TYPE		0x04
 #define AMD_SFH_DEFAULT_MIN_VALUE	0X7F
 #define AMD_SFH_DEFAULT_MAX_VALUE	0x80
@@ -34,6 +41,7 @@
  * @power_state:	Power state of the deivce
  * @sensor_state:	State of the sensor
  * @report_interval	Interval between reports
+ * @report_latency:	Maximum latency of batched reports
  */
 struct common_features {
 	u8 report_id;
@@ -42,6 +50,7 @@ struct common_features {
 	u8 power_state;
 	u8 sensor_state;
 	u32 report_interval;
+	u32 report_latency;
 } __packed;
 
 /**
@@ -56,6 +65,48 @@ struct common_inputs {
 	u8 event_type;
 } __packed;
 
+/**
+ * Reporting states as indices of the respective selectors
+ * in the report descriptors.
+ */
+enum report_state {
+	AMD_SFH_REPORT_NO_EVENTS = 0,
+	AMD_SFH_REPORT_ALL_EVENTS,
+	AMD_SFH_REPORT_THRESHOLD_EVENTS,
+	AMD_SFH_REPORT_NO_EVENTS_WAKE,
+	AMD_SFH_REPORT_ALL_EVENTS_WAKE,
+	AMD_SFH_REPORT_THRESHOLD_EVENTS_WAKE,
+};
+
+/**
+ * struct sensor_settings - Sensor properties configurable by the host.
+ * @report_interval:	Interval between reports in milliseconds
+ * @report_latency:	Maximum latency of batched reports in milliseconds
+ * @report_state:	Reporting state
+ * @sensitivity:	Per-axis change sensitivity for threshold events
+ */
+struct sensor_settings {
+	u32 report_interval;
+	u32 report_latency;
+	u8 report_state;
+	u16 sensitivity[AMD_SFH_MAX_AXES];
+};
+
+/**
+ * struct sensor_sample - Values read from a sensor.
+ * @values:	Per-axis values as reported to the host
+ * @count:	Amount of valid values
+ * @timestamp:	CLOCK_BOOTTIME of the values' acquisition in nanoseconds
+ */
+struct sensor_sample {
+	int values[AMD_SFH_MAX_AXES];
+	u8 count;
+	u64 timestamp;
+};
+
+/* Whether samples keep the full precision of the firmware */
+extern bool amd_sfh_high_precision;
+
 enum sensor_state {
 	AMD_SFH_SENSOR_READY = 0x02,
 	AMD_SFH_SENSOR_INITIALIZING = 0x05,
@@ -65,16 +116,75 @@ enum sensor_state {
  * set_common_features - Sets common values on feature reports.
  * @common:	Pointer to the common features struct
  * @reportnum:	Report number
+ * @settings:	Current sensor settings
  */
 static inline void set_common_features(struct common_features *common,
-				       int report_id)
+				       int report_id,
+				       const struct sensor_settings *settings)
 {
 	common->report_id = report_id;
 	common->connection_type = AMD_SFH_CONNECTION_TYPE;
-	common->report_state = AMD_SFH_REPORT_STATE;
+	common->report_state = settings->report_state;
 	common->power_state = AMD_SFH_POWER_STATE;
 	common->sensor_state = AMD_SFH_SENSOR_INITIALIZING;
-	common->report_interval =  AMD_SFH_REPORT_INTERVAL;
+	common->report_interval = settings->report_interval;
+	common->report_latency = settings->report_latency;
+}
+
+/**
+ * parse_common_features - Reads common values from feature reports.
+ * @buf:	Report buffer
+ * @len:	Size of the report buffer
+ * @settings:	Sensor settings to update
+ *
+ * Returns 0 on success or < zero on errors.
+ */
+static inline int parse_common_features(const u8 *buf, size_t len,
+					struct sensor_settings *settings)
+{
+	struct common_features common;
+
+	if (len < sizeof(common))
+		return -EINVAL;
+
+	memcpy(&common, buf, sizeof(common));
+	settings->report_interval = common.report_interval;
+	settings->report_latency = common.report_latency;
+	settings->report_state = common.report_state;
+	return 0;
+}
+
+/**
+ * threshold_events - Checks for the threshold events reporting state.
+ * @settings:	Sensor settings
+ *
+ * Accepts both selector indices and the selectors' usage IDs.
+ */
+static inline bool threshold_events(const struct sensor_settings *settings)
+{
+	switch (settings->report_state & 0x0F) {
+	case AMD_SFH_REPORT_THRESHOLD_EVENTS:
+	case AMD_SFH_REPORT_THRESHOLD_EVENTS_WAKE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * fw_value - Converts a value written by the firmware to a sample value.
+ * @value:	Value as written by the firmware
+ *
+ * The firmware writes values multiplied by AMD_SFH_FW_MUL.
+ * In high precision mode, they are reported as is and the
+ * unit exponents of the report descriptors are adjusted instead.
+ */
+static inline int fw_value(u32 value)
+{
+	if (amd_sfh_high_precision)
+		return (int)value;
+
+	return (int)value / AMD_SFH_FW_MUL;
 }
 
 /**
@@ -90,31 +200,52 @@ static inline void set_common_inputs(struct common_inputs *common,
 	common->event_type = AMD_SFH_EVENT_TYPE;
 }
 
-/* Sensor interfaces */
-// Accelerometer
-int get_accel_feature_report(int reportnum, u8 *buf, size_t len);
-int get_accel_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr);
-int parse_accel_descriptor(struct hid_device *hid);
-
-// Ambient light sensor
-int get_als_feature_report(int reportnum, u8 *buf, size_t len);
-int get_als_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr,
-			 struct pci_dev *pci_dev, u8 version);
-int parse_als_descriptor(struct hid_device *hid);
-
-// Gyroscope
-int get_gyro_feature_report(int reportnum, u8 *buf, size_t len);
-int get_gyro_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr);
-int parse_gyro_descriptor(struct hid_device *hid);
-
-// Lid switch
-int get_lid_feature_report(int reportnum, u8 *buf, size_t len);
-int get_lid_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr);
-int parse_lid_descriptor(struct hid_device *hid);
-
-// Magnetometer
-int get_mag_feature_report(int reportnum, u8 *buf, size_t len);
-int get_mag_input_report(int reportnum, u8 *buf, size_t len, u32 *cpu_addr);
-int parse_mag_descriptor(struct hid_device *hid);
+/**
+ * struct amd_sfh_sensor_ops - Description and operations of a sensor type.
+ * @sensor_idx:		Index of the sensor on the SFH
+ * @name:		Name of the HID device
+ * @debugfs_name:	Name of the debugfs directory
+ * @descriptor:		HID report descriptor
+ * @descriptor_size:	Size of the HID report descriptor
+ * @sources:		Bitmask of the sensors a virtual sensor is computed from
+ * @optional_sources:	Bitmask of the sensors a virtual sensor uses if present
+ * @get_feature_report:	Writes a feature report from the sensor settings
+ * @set_feature_report:	Reads the sensor settings from a feature report
+ * @get_sample:		Reads the current sample from the DRAM
+ * @get_input_report:	Writes an input report from a sample
+ *
+ * The report functions return the amount of bytes written on success,
+ * all other functions return 0 on success. All return < zero on errors.
+ * Virtual sensors have @sources set and no @get_sample, since
+ * their samples are computed from those of their sources.
+ */
+struct amd_sfh_sensor_ops {
+	enum sensor_idx sensor_idx;
+	const char *name;
+	const char *debugfs_name;
+	u8 *descriptor;
+	unsigned int descriptor_size;
+	unsigned long sources;
+	unsigned long optional_sources;
+	int (*get_feature_report)(int reportnum, u8 *buf, size_t len,
+				  const struct sensor_settings *settings);
+	int (*set_feature_report)(const u8 *buf, size_t len,
+				  struct sensor_settings *settings);
+	int (*get_sample)(u32 *cpu_addr, struct pci_dev *pci_dev, u8 version,
+			  struct sensor_sample *sample);
+	int (*get_input_report)(int reportnum, u8 *buf, size_t len,
+				const struct sensor_sample *sample);
+};
+
+/* Sensor types */
+extern const struct amd_sfh_sensor_ops amd_sfh_accel_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_als_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_gravity_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_gyro_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_lid_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_linear_accel_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_mag_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_orient_ops;
+extern const struct amd_sfh_sensor_ops amd_sfh_screen_ops;
 
 #endif
@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub userspace benchmark
+ *
+ * Runs the sensor functions of the driver against an emulated DMA buffer,
+ * which a writer thread changes at a configurable rate like the firmware
+ * would. Each poll follows the path of a sampled sensor in the driver:
+ * the sample is read from the DRAM, compared with the last one and
+ * formatted into an input report, unless it is suppressed by the
+ * threshold events reporting state. Virtual sensors read the
+ * accelerometer's buffer in place of the fusion code.
+ * Reports ns/report, reports/s and cache misses for each sensor.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "amd-sfh.h"
+#include "amd-sfh-pci.h"
+#include "amd-sfh-perf.h"
+#include "sensors/amd-sfh-sensors.h"
+
+#define BENCH_POLLS		1000000
+#define BENCH_RATE		1000
+#define BENCH_ILLUMINANCE	300
+
+bool amd_sfh_high_precision;
+
+static const struct amd_sfh_sensor_ops *bench_sensors[] = {
+	&amd_sfh_accel_ops,
+	&amd_sfh_gyro_ops,
+	&amd_sfh_mag_ops,
+	&amd_sfh_lid_ops,
+	&amd_sfh_als_ops,
+	&amd_sfh_orient_ops,
+	&amd_sfh_gravity_ops,
+	&amd_sfh_linear_accel_ops,
+	&amd_sfh_screen_ops,
+};
+
+/**
+ * struct bench_dma - Emulated DMA buffer of a sensor.
+ * @slot:	Cache-line-aligned slot written by the emulated firmware
+ * @rate:	Changes of the values per second or zero if they stay put
+ * @stop:	Tells the writer thread to exit
+ */
+struct bench_dma {
+	u32 *slot;
+	unsigned long rate;
+	bool stop;
+};
+
+/**
+ * struct bench_result - Measurements of a sensor.
+ * @polls:	Samples read
+ * @reports:	Input reports written
+ * @duplicates:	Samples equal to the last one
+ * @errors:	Failed reads or reports
+ * @ns:		Time elapsed while polling
+ * @misses:	Cache misses while polling or -1 if unavailable
+ */
+struct bench_result {
+	u64 polls;
+	u64 reports;
+	u64 duplicates;
+	u64 errors;
+	u64 ns;
+	s64 misses;
+};
+
+/**
+ * amd_sfh_get_illuminance - Reads the emulated V2 illuminance register.
+ * @pci_dev:	Unused
+ */
+int amd_sfh_get_illuminance(struct pci_dev *pci_dev)
+{
+	return BENCH_ILLUMINANCE;
+}
+
+static u64 bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * bench_writer - Changes the values of the DMA buffer like the firmware.
+ * @arg:	Emulated DMA buffer
+ *
+ * Writes new values into all words of the sample at the configured rate.
+ */
+static void *bench_writer(void *arg)
+{
+	struct bench_dma *dma = arg;
+	struct timespec next;
+	long period = 1000000000L / dma->rate;
+	u32 value = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&dma->stop, __ATOMIC_RELAXED)) {
+		value += AMD_SFH_FW_MUL;
+		for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+			__atomic_store_n(&dma->slot[i], value + i,
+					 __ATOMIC_RELAXED);
+
+		next.tv_nsec += period;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	return NULL;
+}
+
+/**
+ * bench_get_sample - Reads the current sample of a sensor.
+ * @ops:	Sensor type
+ * @slot:	Emulated DMA slot
+ * @version:	Emulated SFH hardware version
+ * @sample:	Sample to fill
+ *
+ * Virtual sensors, which have no DMA slot, take the values
+ * of the slot as if the fusion code computed them.
+ */
+static int bench_get_sample(const struct amd_sfh_sensor_ops *ops, u32 *slot,
+			    u8 version, struct sensor_sample *sample)
+{
+	int i;
+
+	sample->timestamp = bench_now();
+	if (ops->get_sample)
+		return ops->get_sample(slot, NULL, version, sample);
+
+	for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+		sample->values[i] = fw_value(slot[i]);
+
+	sample->count = AMD_SFH_MAX_AXES;
+	return 0;
+}
+
+/**
+ * bench_sample_equal - Checks whether a sample equals the last sample.
+ * @sample:	Sensor sample
+ * @last:	Last sample
+ *
+ * Mirrors hid_ll_sample_equal().
+ */
+static bool bench_sample_equal(const struct sensor_sample *sample,
+			       const struct sensor_sample *last)
+{
+	return sample->count == last->count &&
+	       !memcmp(sample->values, last->values,
+		       sample->count * sizeof(*sample->values));
+}
+
+/**
+ * bench_sample_changed - Checks whether a sample exceeds the sensitivity.
+ * @sample:	Sensor sample
+ * @last:	Last reported sample
+ * @settings:	Sensor settings
+ *
+ * Mirrors hid_ll_sample_changed().
+ */
+static bool bench_sample_changed(const struct sensor_sample *sample,
+				 const struct sensor_sample *last,
+				 const struct sensor_settings *settings)
+{
+	int i;
+
+	if (sample->count != last->count)
+		return true;
+
+	for (i = 0; i < sample->count; i++) {
+		if (llabs((s64)sample->values[i] - last->values[i]) >
+		    settings->sensitivity[i])
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * bench_sensor - Polls a sensor and writes its input reports.
+ * @ops:	Sensor type
+ * @settings:	Sensor settings
+ * @polls:	Amount of samples to read
+ * @version:	Emulated SFH hardware version
+ * @dma:	Emulated DMA buffer
+ * @perf_fd:	File descriptor of the cache miss counter or < zero
+ * @result:	Measurements to fill
+ */
+static void bench_sensor(const struct amd_sfh_sensor_ops *ops,
+			 const struct sensor_settings *settings, u64 polls,
+			 u8 version, struct bench_dma *dma, int perf_fd,
+			 struct bench_result *result)
+{
+	struct sensor_sample sample, last = { .count = 0 };
+	u8 buf[AMD_SFH_MAX_REPORT_SIZE];
+	u64 misses, start;
+	u64 i;
+	int len;
+
+	memset(result, 0, sizeof(*result));
+	amd_sfh_perf_start(perf_fd);
+	start = bench_now();
+	for (i = 0; i < polls; i++) {
+		if (bench_get_sample(ops, dma->slot, version, &sample)) {
+			result->errors++;
+			continue;
+		}
+
+		if (bench_sample_equal(&sample, &last))
+			result->duplicates++;
+
+		if (threshold_events(settings) &&
+		    !bench_sample_changed(&sample, &last, settings))
+			continue;
+
+		last = sample;
+		len = ops->get_input_report(AMD_SFH_INPUT_REPORT_ID, buf,
+					    sizeof(buf), &sample);
+		if (len <= 0) {
+			result->errors++;
+			continue;
+		}
+
+		result->reports++;
+	}
+
+	result->ns = bench_now() - start;
+	result->polls = polls;
+	result->misses = amd_sfh_perf_stop(perf_fd, &misses) ? -1 : misses;
+}
+
+static void bench_usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n polls] [-r rate] [-s sensitivity] [-v version] "
+		"[-p]\n"
+		"  -n  samples read per sensor (default %d)\n"
+		"  -r  changes of the DMA buffer per second, 0 for none "
+		"(default %d)\n"
+		"  -s  change sensitivity, enables threshold events\n"
+		"  -v  emulated SFH hardware version (default 1)\n"
+		"  -p  keep the full precision of the firmware\n",
+		name, BENCH_POLLS, BENCH_RATE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sensor_settings settings = {
+		.report_state = AMD_SFH_REPORT_ALL_EVENTS,
+	};
+	struct bench_dma dma = { .rate = BENCH_RATE };
+	struct bench_result result;
+	u64 polls = BENCH_POLLS;
+	pthread_t writer;
+	u8 version = 1;
+	int perf_fd, opt, i;
+
+	while ((opt = getopt(argc, argv, "n:r:s:v:ph")) != -1) {
+		switch (opt) {
+		case 'n':
+			polls = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			dma.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			settings.report_state = AMD_SFH_REPORT_THRESHOLD_EVENTS;
+			for (i = 0; i < AMD_SFH_MAX_AXES; i++)
+				settings.sensitivity[i] = strtoul(optarg, NULL,
+								  0);
+			break;
+		case 'v':
+			version = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			amd_sfh_high_precision = true;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!polls || dma.rate > 1000000000UL) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	dma.slot = aligned_alloc(L1_CACHE_BYTES, AMD_SFH_DMA_SLOT_SIZE);
+	if (!dma.slot) {
+		perror("aligned_alloc");
+		return 1;
+	}
+
+	memset(dma.slot, 0, AMD_SFH_DMA_SLOT_SIZE);
+	if (dma.rate && pthread_create(&writer, NULL, bench_writer, &dma)) {
+		perror("pthread_create");
+		free(dma.slot);
+		return 1;
+	}
+
+	perf_fd = amd_sfh_perf_open();
+	printf("%-24s %10s %10s %10s %12s %12s\n", "sensor", "reports",
+	       "duplicates", "ns/report", "reports/s", "misses/poll");
+	for (i = 0; i < (int)(sizeof(bench_sensors) /
+			      sizeof(*bench_sensors)); i++) {
+		bench_sensor(bench_sensors[i], &settings, polls, version, &dma,
+			     perf_fd, &result);
+		printf("%-24s %10llu %10llu %10.1f %12.0f ",
+		       bench_sensors[i]->name,
+		       (unsigned long long)result.reports,
+		       (unsigned long long)result.duplicates,
+		       result.reports ?
+		       (double)result.ns / result.reports : 0.0,
+		       result.ns ? result.reports * 1e9 / result.ns : 0.0);
+		if (result.misses < 0)
+			printf("%12s\n", "-");
+		else
+			printf("%12.3f\n",
+			       (double)result.misses / result.polls);
+
+		if (result.errors)
+			fprintf(stderr, "%s: %llu errors\n",
+				bench_sensors[i]->name,
+				(unsigned long long)result.errors);
+	}
+
+	amd_sfh_perf_close(perf_fd);
+	if (dma.rate) {
+		__atomic_store_n(&dma.stop, true, __ATOMIC_RELAXED);
+		pthread_join(writer, NULL);
+	}
+
+	free(dma.slot);
+	return 0;
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause
+/*
+ * AMD Sensor Fusion Hub benchmark cache miss counter
+ *
+ * Counts the cache misses of the calling thread through perf_event_open().
+ * Built without the shim, since the UAPI headers need the real types.
+ *
+ * Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "amd-sfh-perf.h"
+
+/**
+ * amd_sfh_perf_open - Opens a disabled cache miss counter.
+ *
+ * Returns the file descriptor of the counter or < zero if
+ * the kernel or the hardware does not provide it.
+ */
+int amd_sfh_perf_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * amd_sfh_perf_start - Resets and enables a cache miss counter.
+ * @fd:		File descriptor of the counter or < zero
+ */
+void amd_sfh_perf_start(int fd)
+{
+	if (fd < 0)
+		return;
+
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/**
+ * amd_sfh_perf_stop - Disables and reads a cache miss counter.
+ * @fd:		File descriptor of the counter or < zero
+ * @misses:	Amount of cache misses since the start
+ *
+ * Returns 0 on success or < zero if the counter is unavailable.
+ */
+int amd_sfh_perf_stop(int fd, uint64_t *misses)
+{
+	if (fd < 0)
+		return -1;
+
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, misses, sizeof(*misses)) != sizeof(*misses))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * amd_sfh_perf_close - Closes a cache miss counter.
+ * @fd:		File descriptor of the counter or < zero
+ */
+void amd_sfh_perf_close(int fd)
+{
+	if (fd >= 0)
+		close(fd);
+}
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub benchmark cache miss counter
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_PERF_H
+#define AMD_SFH_PERF_H
+
+#include <stdint.h>
+
+int amd_sfh_perf_open(void);
+void amd_sfh_perf_start(int fd);
+int amd_sfh_perf_stop(int fd, uint64_t *misses);
+void amd_sfh_perf_close(int fd);
+
+#endif
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+/*
+ *  AMD Sensor Fusion Hub userspace shim
+ *
+ *  Provides the subset of the kernel API used by the sensor
+ *  functions, so that they can be built into a userspace program.
+ *  The headers under include/linux/ only include this file.
+ *
+ *  Author:	Richard Neumann <mail@richard-neumann.de>
+ */
+
+#ifndef AMD_SFH_SHIM_H
+#define AMD_SFH_SHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int32_t __s32;
+typedef unsigned int uint;
+typedef u64 dma_addr_t;
+typedef s64 ktime_t;
+
+#define __iomem
+#define __packed		__attribute__((packed))
+#define L1_CACHE_BYTES		64
+
+#define IS_ENABLED(option)	0
+#define EXPORT_SYMBOL_GPL(symbol)
+
+#define BIT(nr)			(1UL << (nr))
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define min(x, y)		((x) < (y) ? (x) : (y))
+#define ilog2(n)		(63 - __builtin_clzll(n))
+#define ktime_to_ns(kt)		(kt)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+/* Opaque to the sensor functions and only embedded by the driver data */
+struct mutex {
+	int unused;
+};
+
+struct hrtimer {
+	int unused;
+};
+
+struct kthread_work {
+	int unused;
+};
+
+struct dentry;
+struct kthread_worker;
+struct pci_dev;
+
+#endif